@@ -1,27 +1,210 @@
+#pragma once
+
 #include "data.h"
 #include "ui.h"
 #include "xoshiro256pp.h"
+#include <cstddef>
 #include <cstdint>
-#include <functional>
+#include <vector>
 
 #define MAX_TEMP 1'000'000'000'000
 
 enum move { SHIFT, SWAP, FLIP_H, FLIP_V, ROT_CW, ROT_CC, LAST };
 
-bool try_random_move(Data &blocks, uint32_t window_x, uint32_t window_y);
+// Ranges of the random numbers of try_random_move(). Only change when the
+// window or the number of blocks does, so build once per step
+struct move_ranges {
+  move_ranges(const Data &data, uint32_t window_x, uint32_t window_y);
+
+  bounded_range moves;
+  bounded_range blocks;
+  bounded_range shift_x;
+  bounded_range shift_y;
+  uint32_t window_x;
+  uint32_t window_y;
+};
+
+// A random move, drawn before it is made
+struct move_proposal {
+  move type;
+  size_t block;
+  // Second block of a swap
+  size_t other;
+  int32_t x;
+  int32_t y;
+};
+
+move_proposal draw_move(Xoshiro256pp &rng, const move_ranges &ranges);
+// Returns false and leaves data unchanged if the move is not legal
+bool make_move(Data &data, const move_proposal &m);
+
+// make_move() of draw_move()
+bool try_random_move(Data &blocks, Xoshiro256pp &rng,
+                     const move_ranges &ranges);
+bool try_random_move(Data &blocks, Xoshiro256pp &rng, uint32_t window_x,
+                     uint32_t window_y);
+
+// hpwl(), mcl() and star() split large netlists over this many threads. The
+// default is the number of hardware threads
+void set_cost_threads(uint32_t threads);
+
+// Logs for nets of degree 0-1, 2, 3-4, 5-8 and so on how many there are, their
+// share of the cost and how long cost_fn takes for them. Used to choose the
+// threshold of Data::set_large_nets()
+void log_net_degrees(Data &data, uint64_t (*cost_fn)(const pin_span &));
 
-uint64_t hpwl_net(net &net);
+uint64_t hpwl_net(const pin_span &pins);
 
 uint64_t hpwl(Data &data);
 
-uint64_t mcl_net(net &net);
+// Bounding box of a net
+struct net_box {
+  uint32_t min_x;
+  uint32_t max_x;
+  uint32_t min_y;
+  uint32_t max_y;
+  // Number of pins on each edge
+  uint32_t on_min_x;
+  uint32_t on_max_x;
+  uint32_t on_min_y;
+  uint32_t on_max_y;
+  // An edge lost its last pin, the box has to be scanned again
+  bool stale;
+};
+
+// Same cost as hpwl_net(), but keeps the bounding box of every net together
+// with the number of pins on each of its edges. A moved pin updates the box in
+// O(1), the net is only scanned again once the last pin left one of the edges.
+// Small nets are simply evaluated again
+class hpwl_cost final : public incremental_cost {
+public:
+  void reset(size_t num_nets) override;
+  uint64_t init_net(size_t net_index, const pin_span &pins) override;
+  void move_pin(size_t net_index, const pin_span &pins, size_t slot,
+                uint32_t old_x, uint32_t old_y) override;
+  uint64_t net_cost(size_t net_index, const pin_span &pins) override;
+
+private:
+  std::vector<net_box> boxes;
+};
+
+// Length of the chain through the pins sorted by x, then y
+uint64_t mcl_net(const pin_span &pins);
 
 uint64_t mcl(Data &data);
 
-uint64_t star_net(net &net);
+// Same cost as mcl_net(), but keeps the sorted order of every net. A moved pin
+// is taken out of the chain and inserted again at its new position, so only
+// the segments next to its old and new position change
+class mcl_cost final : public incremental_cost {
+public:
+  void reset(size_t num_nets) override;
+  uint64_t init_net(size_t net_index, const pin_span &pins) override;
+  void move_pin(size_t net_index, const pin_span &pins, size_t slot,
+                uint32_t old_x, uint32_t old_y) override;
+  uint64_t net_cost(size_t net_index, const pin_span &pins) override;
+
+private:
+  // Net i owns [begin[i], begin[i] + pins.size) of order and position.
+  // order holds the pin slots in chain order, position the place of every
+  // slot in order
+  std::vector<size_t> begin;
+  std::vector<uint32_t> order;
+  std::vector<uint32_t> position;
+  std::vector<uint64_t> costs;
+};
+
+uint64_t star_net(const pin_span &pins);
 
 uint64_t star(Data &data);
 
+// Same cost as star_net(), but keeps the root and the summed distance of every
+// net. Moving any other pin only changes its own distance, moving the root
+// sums the net again once its cost is asked for
+class star_cost final : public incremental_cost {
+public:
+  void reset(size_t num_nets) override;
+  uint64_t init_net(size_t net_index, const pin_span &pins) override;
+  void move_pin(size_t net_index, const pin_span &pins, size_t slot,
+                uint32_t old_x, uint32_t old_y) override;
+  uint64_t net_cost(size_t net_index, const pin_span &pins) override;
+
+private:
+  struct star {
+    uint64_t sum;
+    // The root moved, sum has to be computed again
+    bool stale;
+  };
+
+  std::vector<star> stars;
+};
+
+// Length of a rectilinear Steiner tree of the pins. Exact up to
+// POWV_MAX_DEGREE pins (see src/powv_gen.cpp), larger nets use the shorter of
+// the two single trunk trees
+uint64_t rsmt_net(const pin_span &pins);
+
+uint64_t rsmt(Data &data);
+
+// rsmt_net() of every dirty net. Data keeps the cost of every net, so only the
+// nets of moved pins are estimated again
+class rsmt_cost final : public incremental_cost {
+public:
+  void reset(size_t num_nets) override {}
+  uint64_t init_net(size_t net_index, const pin_span &pins) override {
+    return rsmt_net(pins);
+  }
+  void move_pin(size_t net_index, const pin_span &pins, size_t slot,
+                uint32_t old_x, uint32_t old_y) override {}
+  uint64_t net_cost(size_t net_index, const pin_span &pins) override {
+    return rsmt_net(pins);
+  }
+};
+
+// Default edge length of a RUDY bin
+#define RUDY_BIN_SIZE 32
+
+// Adds routing congestion to the cost of Wirelength. Every net spreads its half
+// perimeter evenly over its bounding box (rectangular uniform wire density,
+// RUDY) on a grid of bins over the chip. The congestion cost is the sum of the
+// squared demand of every bin times weight divided by the bin area, so the same
+// wire costs more the more it piles up. A moved pin only touches the bins of
+// the old and the new box of its net, and only if the box changed. The bins are
+// brought up to date once per cost update, so a net whose box changes several
+// times in between only moves its demand once
+template <class Wirelength> class rudy_cost final : public incremental_cost {
+public:
+  rudy_cost(uint32_t chip_x, uint32_t chip_y, uint64_t weight,
+            uint32_t bin_size = RUDY_BIN_SIZE);
+  void reset(size_t num_nets) override;
+  uint64_t init_net(size_t net_index, const pin_span &pins) override;
+  void move_pin(size_t net_index, const pin_span &pins, size_t slot,
+                uint32_t old_x, uint32_t old_y) override;
+  uint64_t net_cost(size_t net_index, const pin_span &pins) override;
+  uint64_t global_cost() override;
+
+private:
+  // Adds or removes the demand of a box
+  void spread(const net_box &b, bool add);
+
+  Wirelength wirelength;
+  uint64_t weight;
+  uint32_t bin_size;
+  size_t bins_x;
+  size_t bins_y;
+  // Box of the current pins of every net
+  std::vector<net_box> boxes;
+  // Box every net currently spreads its demand over
+  std::vector<net_box> spread_boxes;
+  // Nets whose pins moved since the bins were updated. The netlist doesn't
+  // change between a move and the next cost update, so their spans stay valid
+  std::vector<bool> pending;
+  std::vector<std::pair<size_t, pin_span>> pending_nets;
+  std::vector<uint64_t> demand;
+  // Sum of the squares of demand
+  uint64_t demand_squared;
+};
+
 // NOTE: Maximum temperature is 1'000'000'000'000. This means that 100% of
 // changes are accpeted, even if they have a worse cost. Consequently a
 // temperature of 0 results in only improving moves being accepted. Tuning steps
@@ -30,9 +213,80 @@ uint64_t star(Data &data);
 // Warm-up steps are the number of steps performed, before checking and saving
 // the best current result. This can be used to increase performance when the
 // very bad initial placement is massively improved.
-uint64_t anneal(Data &data, std::function<uint64_t(Data&)> cost_fn, uint64_t initial_temp, uint64_t final_temp,
+// per_move accepts or rejects every move on its own instead of the moves of a
+// whole step at once. The moves per step are then the moves per temperature.
+// cost has to be the cost data was set up with by init_cost(). All random
+// decisions come from rng, so the same seed gives the same placement. Only the
+// nets touched by the moves of a step are re-evaluated. anneal() is compiled for
+// hpwl_cost, mcl_cost, star_cost and rsmt_cost, so their updates are inlined
+// into the loop. rudy_cost is compiled on top of each of them
+template <class Cost>
+uint64_t anneal(Data &data, Cost &cost, Xoshiro256pp &rng,
+                uint64_t initial_temp, uint64_t final_temp,
                 uint32_t initial_window_x, uint32_t final_window_x,
                 uint32_t initial_window_y, uint32_t final_window_y,
                 uint64_t steps, uint64_t warmup_steps, uint64_t tuning_steps,
                 uint32_t initial_moves_per_step, uint32_t final_moves_per_step,
-                bool logging_enabled, log logger);
+                bool per_move, bool logging_enabled, log logger);
+
+// Parallel tempering. replicas copies of data, which share its netlist, each
+// anneal on a thread of their own at a fixed temperature. The temperatures
+// are spaced geometrically from initial_temp down to final_temp, the windows
+// and moves per step follow linearly. Every exchange_interval steps
+// neighboring temperatures offer to swap their placements: the colder one
+// always takes a better placement and a worse one with the chance of its own
+// temperature. The replicas use streams jumped ahead from rng, rng itself
+// decides the swaps. steps is the number of steps of every replica. Afterwards
+// data holds the best placement of all replicas, and the tuning steps run on it
+template <class Cost>
+uint64_t anneal_tempering(Data &data, Cost &cost, Xoshiro256pp &rng,
+                          uint32_t replicas,
+                          uint64_t exchange_interval, uint64_t initial_temp,
+                          uint64_t final_temp, uint32_t initial_window_x,
+                          uint32_t final_window_x, uint32_t initial_window_y,
+                          uint32_t final_window_y, uint64_t steps,
+                          uint64_t warmup_steps, uint64_t tuning_steps,
+                          uint32_t initial_moves_per_step,
+                          uint32_t final_moves_per_step, bool per_move,
+                          bool logging_enabled, log logger);
+
+// Multi-start annealing. islands copies of data, which share its netlist, each
+// run the whole schedule of anneal() on a thread of their own, with streams
+// jumped ahead from rng. Every migration_interval steps the worse half of the
+// islands drops its placement and continues from the best placement any
+// island has found. steps is the number of steps of every island. Afterwards
+// data holds the best placement of all islands, and the tuning steps run on it
+template <class Cost>
+uint64_t anneal_islands(Data &data, Cost &cost, Xoshiro256pp &rng,
+                        uint32_t islands, uint64_t migration_interval,
+                        uint64_t initial_temp, uint64_t final_temp,
+                        uint32_t initial_window_x, uint32_t final_window_x,
+                        uint32_t initial_window_y, uint32_t final_window_y,
+                        uint64_t steps, uint64_t warmup_steps,
+                        uint64_t tuning_steps, uint32_t initial_moves_per_step,
+                        uint32_t final_moves_per_step, bool per_move,
+                        bool logging_enabled, log logger);
+
+// anneal() with every move accepted or rejected on its own, as with per_move,
+// but with the moves evaluated by several threads. The main thread draws a
+// batch of moves, every thread makes its share of them on its own copy of the
+// placement, notes the cost delta and rolls the move back. The main thread
+// then decides in the order the moves were drawn. Moves that share a net or
+// the area around their blocks with a move accepted earlier in the batch are
+// evaluated again on data, the deltas of all others still hold. So the moves
+// are decided as if they were made one after the other, and the result is
+// the same for any number of threads. The batch grows up to batch_size while
+// few moves conflict, so it pays off at low temperatures where most moves are
+// rejected. With rudy_cost the deltas within a batch are only estimates, the
+// cost after each batch is exact
+template <class Cost>
+uint64_t anneal_speculative(Data &data, Cost &cost, Xoshiro256pp &rng,
+                            uint32_t threads, uint32_t batch_size,
+                            uint64_t initial_temp, uint64_t final_temp,
+                            uint32_t initial_window_x, uint32_t final_window_x,
+                            uint32_t initial_window_y, uint32_t final_window_y,
+                            uint64_t steps, uint64_t warmup_steps,
+                            uint64_t tuning_steps,
+                            uint32_t initial_moves_per_step,
+                            uint32_t final_moves_per_step,
+                            bool logging_enabled, log logger);
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for storage that lives as long as the netlist. Freeing
+// single allocations does nothing, everything is released when the arena is
+// destroyed. Use it through std::pmr containers.
+//
+// Chunks are taken straight from mmap and double in size up to
+// ARENA_MAX_CHUNK. Chunks of at least ARENA_HUGE_PAGE bytes are aligned to
+// it and backed by transparent huge pages if the kernel allows it, so large
+// designs need fewer TLB entries for the netlist
+#define ARENA_MIN_CHUNK (64 * 1024)
+#define ARENA_MAX_CHUNK (64 * 1024 * 1024)
+#define ARENA_HUGE_PAGE (2 * 1024 * 1024)
+
+class Arena : public std::pmr::memory_resource {
+public:
+  Arena();
+  ~Arena();
+  Arena(const Arena &) = delete;
+  Arena &operator=(const Arena &) = delete;
+
+  // Bytes handed out so far
+  size_t used();
+  // Bytes mapped for the chunks
+  size_t reserved();
+
+private:
+  struct chunk {
+    void *start;
+    size_t size;
+  };
+
+  std::vector<chunk> chunks;
+  char *current;
+  char *end;
+  size_t next_chunk_size;
+  size_t used_bytes;
+  size_t reserved_bytes;
+
+  void new_chunk(size_t min_size);
+
+  void *do_allocate(size_t bytes, size_t alignment) override;
+  void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+  bool do_is_equal(const std::pmr::memory_resource &other) const
+      noexcept override;
+};
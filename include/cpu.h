@@ -0,0 +1,4 @@
+#pragma once
+
+// Decided once at startup, so the binary still runs on CPUs without AVX2
+extern const bool has_avx2;
@@ -1,31 +1,165 @@
 #pragma once
 
+#include "arena.h"
+#include "panic.h"
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <span>
 #include <tuple>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 // NOTE: Block ids and Net ids have to be unique
 
+// Corner of a block its pins sit on, top left if no bit is set
+#define CORNER_RIGHT 1
+#define CORNER_BOTTOM 2
+
 struct block {
   uint64_t id;
   uint32_t x;
   uint32_t y;
   uint32_t len_x;
   uint32_t len_y;
+  // Only read by Data::add_block(), the blocks stored in Data keep their nets
+  // in the pin index and leave this empty
   std::vector<uint64_t> net_ids;
+  // Changed by rotations and flips
+  uint8_t corner = 0;
 };
 
+// Position of the pins of a block
+inline uint32_t pin_pos_x(const block &b) {
+  return b.x + ((b.corner & CORNER_RIGHT) ? b.len_x - 1 : 0);
+}
+
+inline uint32_t pin_pos_y(const block &b) {
+  return b.y + ((b.corner & CORNER_BOTTOM) ? b.len_y - 1 : 0);
+}
+
+// The pins of a net are stored in Data, see pin_span
 struct net {
   uint64_t id;
-  std::vector<std::tuple<uint64_t, uint32_t, uint32_t>> pins;
-  // TODO: Replace with single vector and keep count of beginning and end for
-  // each block
-  //
-  // NOTE: Until we know anything better, we assume all pins are
-  // at top left block corner. Pin position is neither in genlib, liberty, nor
-  // verilog file
-  // Coordinate system 0, 0 is top-left
+};
+
+// View on the pins of one net as (block id, x, y). Input and output pins have
+// the block id UINT64_MAX. The pins of all nets live in one set of buffers
+// inside Data, so a span is only valid until the next net or block is added
+// or a block of the net is moved
+//
+// NOTE: Until we know anything better, we assume all pins are
+// at top left block corner. Pin position is neither in genlib, liberty, nor
+// verilog file
+// Coordinate system 0, 0 is top-left
+struct pin_span {
+  const uint64_t *ids;
+  const uint32_t *x;
+  const uint32_t *y;
+  size_t size;
+
+  std::tuple<uint64_t, uint32_t, uint32_t> operator[](size_t i) const {
+    return {ids[i], x[i], y[i]};
+  }
+};
+
+// Net cost that follows single pin moves instead of evaluating the whole net
+// again. Data tells it about every pin that changes its position, so its
+// state always matches the current pins
+class incremental_cost {
+public:
+  virtual ~incremental_cost() = default;
+  // Called by init_cost() before init_net() is called for every net that
+  // isn't skipped
+  virtual void reset(size_t num_nets) = 0;
+  // Builds the state of the net and returns its cost
+  virtual uint64_t init_net(size_t net_index, const pin_span &pins) = 0;
+  // The pin in slot moved away from old_x and old_y. pins already holds the
+  // new position
+  virtual void move_pin(size_t net_index, const pin_span &pins, size_t slot,
+                        uint32_t old_x, uint32_t old_y) = 0;
+  // Cost of the net with the current pins
+  virtual uint64_t net_cost(size_t net_index, const pin_span &pins) = 0;
+  // Cost that doesn't belong to a single net, added to the sum of the net
+  // costs. Has to follow from the current pins alone, so it is back at its old
+  // value once a rollback has written the old pins again
+  virtual uint64_t global_cost() { return 0; }
+};
+
+// Evaluates every dirty net again with a function of its pins
+class function_cost final : public incremental_cost {
+public:
+  function_cost(uint64_t (*cost_fn)(const pin_span &) = nullptr)
+      : cost_fn(cost_fn) {}
+  void reset(size_t num_nets) override {}
+  uint64_t init_net(size_t net_index, const pin_span &pins) override {
+    return cost_fn(pins);
+  }
+  void move_pin(size_t net_index, const pin_span &pins, size_t slot,
+                uint32_t old_x, uint32_t old_y) override {}
+  uint64_t net_cost(size_t net_index, const pin_span &pins) override {
+    return cost_fn(pins);
+  }
+
+private:
+  uint64_t (*cost_fn)(const pin_span &);
+};
+
+// Weight of a net that is neither skipped nor down-weighted, in percent
+#define NET_WEIGHT_FULL 100
+
+// How Data::set_large_nets() handles nets above the degree threshold
+enum large_net_mode {
+  // Evaluated like every other net
+  LARGE_NETS_KEEP,
+  // Left out of the cost. Their pins are still written, but moves neither
+  // mark them dirty nor tell the cost about their pins
+  LARGE_NETS_SKIP,
+  // Cost multiplied by a weight in percent
+  LARGE_NETS_WEIGHT
+};
+
+// The parts of the netlist that don't change while annealing. Copies of a
+// Data share it, so they only duplicate the placement
+struct netlist {
+  netlist() : block_id_to_index(&arena), net_id_to_index(&arena) {}
+
+  // Owns the small per-block and per-net allocations of the netlist
+  Arena arena;
+
+  std::vector<net> nets;
+
+  // External ids can be arbitrary, internally everything uses the index into
+  // blocks and nets. The way back is blocks[i].id and nets[i].id
+  std::pmr::unordered_map<uint64_t, size_t> block_id_to_index;
+  std::pmr::unordered_map<uint64_t, size_t> net_id_to_index;
+
+  // Pins of all nets in compressed sparse row form, the positions are in
+  // Data::pin_x and Data::pin_y. Net i owns the pins
+  // [pin_begin[i], pin_begin[i] + pin_count[i]). A net that outgrows its
+  // pin_capacity[i] while the netlist is loaded is moved to the end of the
+  // buffers, compact_pins() closes the gaps afterwards
+  std::vector<uint64_t> pin_ids;
+  std::vector<size_t> pin_begin;
+  std::vector<size_t> pin_count;
+  std::vector<size_t> pin_capacity;
+
+  // Pins of every block as (net index, pin slot), so moves can find the nets
+  // they touch without searching the nets for the block id
+  std::vector<std::pmr::vector<std::pair<size_t, size_t>>> block_pins;
+
+  std::vector<uint64_t> input_ids;
+  std::vector<uint64_t> output_ids;
+
+  // Net indices by degree, see Data::get_degree_bucket(). Built on first use
+  // after the netlist changed, copies can ask for them from several threads
+  std::vector<size_t> degree_buckets[4];
+  std::atomic<bool> degree_buckets_valid = false;
+  std::mutex degree_buckets_mutex;
 };
 
 class Data {
@@ -36,22 +170,97 @@ public:
   uint32_t chip_y;
 
 private:
+  // The members below refer into it
+  std::shared_ptr<netlist> shared;
+  std::vector<net> &nets;
+  std::pmr::unordered_map<uint64_t, size_t> &block_id_to_index;
+  std::pmr::unordered_map<uint64_t, size_t> &net_id_to_index;
+  std::vector<uint64_t> &pin_ids;
+  std::vector<size_t> &pin_begin;
+  std::vector<size_t> &pin_count;
+  std::vector<size_t> &pin_capacity;
+  std::vector<std::pmr::vector<std::pair<size_t, size_t>>> &block_pins;
+  std::vector<uint64_t> &input_ids;
+  std::vector<uint64_t> &output_ids;
+
   std::vector<block> blocks;
-  std::vector<net> nets;
+  // Pin positions, laid out like netlist::pin_ids
+  std::vector<uint32_t> pin_x;
+  std::vector<uint32_t> pin_y;
 
-  std::vector<uint64_t> input_ids;
-  std::vector<uint64_t> output_ids;
+  // Moves only change the block. The pin positions are derived from the
+  // blocks moved since the pins were last read, see update_pins()
+  std::vector<bool> pins_stale;
+  std::vector<size_t> stale_pin_blocks;
 
-  std::vector<block> reset_blocks;
-  std::vector<net> reset_nets;
+  // Undo log entries. They hold the values before the move
+  struct block_undo {
+    size_t index;
+    uint32_t x;
+    uint32_t y;
+    uint32_t len_x;
+    uint32_t len_y;
+    uint8_t corner;
+  };
+
+  // Uniform bin grid over the chip. Every bin holds the blocks overlapping it,
+  // including their right and bottom edge, so legal() only has to look at the
+  // bins the candidate block covers. The geometry is copied into the bin as
+  // structure of arrays, so a bin can be checked 8 blocks at a time without
+  // touching the blocks vector
+  struct bin {
+    std::vector<size_t> index;
+    std::vector<uint32_t> x;
+    std::vector<uint32_t> y;
+    std::vector<uint32_t> x_end;
+    std::vector<uint32_t> y_end;
+  };
+
+  uint32_t bin_size;
+  size_t bins_x;
+  size_t bins_y;
+  std::vector<bin> bins;
+
+  bool transaction_open;
+  std::vector<block_undo> block_log;
+
+  // Best placement found so far. Only the block geometry and the corner the
+  // pins sit on are saved, the pins are rebuilt when they are asked for
+  std::vector<uint32_t> best_x;
+  std::vector<uint32_t> best_y;
+  std::vector<uint32_t> best_len_x;
+  std::vector<uint32_t> best_len_y;
+  std::vector<uint8_t> best_corner;
+  // Blocks moved since the last save_best()
+  std::vector<bool> best_stale;
+  std::vector<size_t> best_stale_blocks;
+  bool best_pins_valid;
+  std::vector<uint32_t> best_pin_x;
+  std::vector<uint32_t> best_pin_y;
 
-  std::vector<block> best_blocks;
-  std::vector<net> best_nets;
+  // Used for init_cost() with a function and to write pins before init_cost()
+  function_cost fn_cost;
+  incremental_cost *cost_model;
+  // Sum of net_costs, total_cost adds the global cost of the model
+  uint64_t net_total;
+  uint64_t total_cost;
+  std::vector<uint64_t> net_costs;
+  // In percent, 0 for skipped nets
+  std::vector<uint32_t> net_weight;
+  std::vector<bool> net_dirty;
+  std::vector<size_t> dirty_nets;
+  // Old costs of the nets re-evaluated during the transaction
+  std::vector<std::pair<size_t, uint64_t>> cost_journal;
+  uint64_t rollback_net_total;
+  uint64_t rollback_total_cost;
 
 public:
   Data(uint32_t chip_x, uint32_t chip_y);
-  // Nets should be enumerated from id 0 to n and added in that order to make
-  // the program run much faster
+  // Replica of other that shares its netlist and copies its placement, best
+  // placement and cached costs. The netlist can't be changed any more once it
+  // is shared. The copy still reports to the cost of other, call init_cost()
+  // with a cost of its own before moving blocks
+  Data(const Data &other) = default;
   void add_net(net n);
 
   void add_input(uint64_t id);
@@ -61,13 +270,24 @@ public:
 
   // Only call this method after all nets have been added. Assumes that b.nets
   // contains net ids in this.net_ids
-  void add_block(block b);
+  void add_block(const block &b);
 
   // TODO: Implement iterator (Is it needed tho?)
   block &get_block_by_index(size_t index);
   net &get_net_by_index(size_t index);
   block &get_block_by_id(uint64_t id);
   net &get_net_by_id(uint64_t id);
+  // Only writes pins if a block moved since the last call. After
+  // update_pins() it can be called from several threads until the next move
+  pin_span get_pins(size_t net_index);
+  pin_span get_pins(net &n);
+  // Writes the pins of all blocks moved since the pins were last read
+  void update_pins();
+  // Indices of the nets with 2, 3 and 4 pins (buckets 0 to 2) and with any
+  // other number of pins (bucket 3), in ascending order
+  const std::vector<size_t> &get_degree_bucket(size_t bucket);
+  // Nets the block with this index has pins on, as (net index, pin slot)
+  std::span<const std::pair<size_t, size_t>> get_block_nets(size_t index);
 
   // block &get_by_pos(uint32_t x, uint32_t y);
   size_t get_index_from_pos(uint32_t x, uint32_t y);
@@ -79,8 +299,8 @@ public:
   bool overlap(block &a, block &b);
   bool legal(block &a);
 
-  // try_x will check if move is legal, execute if possible and update
-  // pin positions in nets
+  // try_x will check if move is legal, execute if possible and mark the nets
+  // of the block as dirty
   bool try_shift(block &b, int32_t x, int32_t y);
   bool try_swap(block &b1, block &b2);
   bool try_rot_cw(block &b);
@@ -88,17 +308,98 @@ public:
   bool try_flip_h(block &b);
   bool try_flip_v(block &b);
 
-  // WARNING: These copy the entire blocks and nets vectors, so they can get
-  // very expensive!
-  void save_state();
-  void reset_state();
+  // Every successful try_x move inside a transaction appends the old block
+  // geometry to an undo log. rollback() restores the state from
+  // begin_transaction() and only costs as much as the moves made since.
+  // Moves outside of a transaction are not logged.
+  void begin_transaction();
+  void commit();
+  void rollback();
 
+  // Incremental cost engine. init_cost() evaluates every net once and caches
+  // the per-net costs. Afterwards the try_x moves mark the nets they touch as
+  // dirty and update_cost() only re-evaluates those.
+  // Call it after the netlist is complete, the incremental cost must outlive
+  // its use by Data
+  uint64_t init_cost(uint64_t (*cost_fn)(const pin_span &));
+  uint64_t init_cost(incremental_cost &cost);
+  uint64_t update_cost();
+  // Same as update_cost(), but calls cost directly. If Cost is a final class
+  // the compiler can inline it into the caller. cost has to be the one given
+  // to init_cost()
+  template <class Cost> uint64_t update_cost(Cost &cost);
+  uint64_t get_cost();
+  // Nets with more than threshold pins are skipped or weighted with weight
+  // percent instead of being fully evaluated. Call it before init_cost().
+  // Returns the number of these nets
+  size_t set_large_nets(size_t threshold, large_net_mode mode,
+                        uint32_t weight);
+
+  // Only copies the blocks moved since the last call
   void save_best();
 
   std::vector<block> get_best_blocks();
-  std::vector<net> get_best_nets();
+  // Moves every block to the geometry of the block with the same index in
+  // placement, e.g. the best blocks of a copy. Doesn't check legality. The
+  // nets of moved blocks are dirty afterwards, so update_cost() brings the
+  // cost up to date
+  void set_placement(const std::vector<block> &placement);
+  // NOTE: The first call after save_best() rebuilds the pins of all nets
+  pin_span get_best_pins(size_t net_index);
 
 private:
+  void mark_dirty(size_t net_index);
+  void mark_moved(size_t index);
+  void save_best_block(size_t index);
+  // Panics if the netlist is shared with a copy
+  void own_netlist();
+  // Inserts a pin into the net at the given slot and moves the net to the end
+  // of the pin buffers if it is full
+  void insert_pin(size_t net_index, size_t slot, uint64_t id, uint32_t x,
+                  uint32_t y);
+  // Removes the gaps in the pin buffers left by nets that had to grow
+  void compact_pins();
+  // Rebuilds block_pins after blocks or pins changed their order
+  void build_pin_index();
+  // Same as legal(a), but also ignores the block with other_id
+  bool legal(block &a, uint64_t other_id);
+  // Drops all bins and reinserts every block with the new bin size
+  void build_bins(uint32_t size);
+  void bin_range(uint32_t x, uint32_t y, uint32_t len_x, uint32_t len_y,
+                 size_t &first_x, size_t &last_x, size_t &first_y,
+                 size_t &last_y);
+  size_t find_in_bin(bin &bin, size_t index);
+  void insert_bins(size_t index);
+  void remove_bins(size_t index, uint32_t x, uint32_t y, uint32_t len_x,
+                   uint32_t len_y);
+  // Moves the block from the bins of its old geometry to the bins of its
+  // current geometry
+  void update_bins(size_t index, uint32_t x, uint32_t y, uint32_t len_x,
+                   uint32_t len_y);
+  void log_block(block &b, uint32_t x, uint32_t y, uint32_t len_x,
+                 uint32_t len_y, uint8_t corner);
+  // Marks all nets of the block as dirty and its pins as stale
+  void touch_block(size_t index);
+  void mark_pins_stale(size_t index);
+  // Writes the pin positions of the block from its geometry and tells cost
+  // about every pin that moved
+  template <class Cost> void write_pins(size_t index, Cost &cost);
+  // Writes the pins of all stale blocks
+  template <class Cost> void update_pins(Cost &cost);
+  // The cost moved pins are reported to
+  incremental_cost &current_cost();
+  // Cost of the net with its weight
+  uint64_t weigh(size_t net_index, uint64_t cost) {
+    uint32_t weight = net_weight[net_index];
+    return weight == NET_WEIGHT_FULL ? cost : cost * weight / NET_WEIGHT_FULL;
+  }
+  // Same as get_pins(net_index), but doesn't write stale pins
+  pin_span pins_of(size_t net_index) {
+    size_t begin = pin_begin[net_index];
+    return {pin_ids.data() + begin, pin_x.data() + begin,
+            pin_y.data() + begin, pin_count[net_index]};
+  }
+
   struct SkylineNode {
     uint32_t x;
     uint32_t y;
@@ -138,3 +439,49 @@ private:
     uint32_t next_height;
   };
 };
+
+template <class Cost> void Data::write_pins(size_t index, Cost &cost) {
+  block &b = blocks[index];
+  uint32_t x = pin_pos_x(b);
+  uint32_t y = pin_pos_y(b);
+  for (auto [net_index, slot] : block_pins[index]) {
+    size_t p = pin_begin[net_index] + slot;
+    uint32_t old_x = pin_x[p];
+    uint32_t old_y = pin_y[p];
+    pin_x[p] = x;
+    pin_y[p] = y;
+    if ((old_x != x || old_y != y) && net_weight[net_index] != 0) {
+      cost.move_pin(net_index, pins_of(net_index), slot, old_x, old_y);
+    }
+  }
+}
+
+template <class Cost> void Data::update_pins(Cost &cost) {
+  if (stale_pin_blocks.empty()) {
+    return;
+  }
+  for (size_t i : stale_pin_blocks) {
+    write_pins(i, cost);
+    pins_stale[i] = false;
+  }
+  stale_pin_blocks.clear();
+}
+
+template <class Cost> uint64_t Data::update_cost(Cost &cost) {
+  if (cost_model != &cost) {
+    panic("Called update_cost() with a different cost than init_cost()");
+  }
+  update_pins(cost);
+  for (size_t i : dirty_nets) {
+    uint64_t net_cost = weigh(i, cost.net_cost(i, pins_of(i)));
+    if (transaction_open) {
+      cost_journal.emplace_back(i, net_costs[i]);
+    }
+    net_total = net_total - net_costs[i] + net_cost;
+    net_costs[i] = net_cost;
+    net_dirty[i] = false;
+  }
+  dirty_nets.clear();
+  total_cost = net_total + cost.global_cost();
+  return total_cost;
+}
@@ -1,10 +1,15 @@
+#include "arena.h"
 #include "data.h"
 #include "debug.h"
 #include "lorina/diagnostics.hpp"
 #include "lorina/genlib.hpp"
 #include "lorina/verilog.hpp"
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 
@@ -18,6 +23,15 @@ struct genlib_gate {
   std::vector<std::string> pin_names;
 };
 
+// Allows looking up std::pmr::string keys with any string without
+// constructing a key first
+struct string_hash {
+  using is_transparent = void;
+  size_t operator()(std::string_view s) const {
+    return std::hash<std::string_view>{}(s);
+  }
+};
+
 // TODO:
 // Give pins different positions on block (Maybe read from lef file)
 // Add output and input pins to the edge of the chip and allow moving them
@@ -50,10 +64,18 @@ private:
   Data &data;
   mutable uint64_t block_num;
   mutable uint64_t net_num;
+  // Owns the names and map nodes below. They are only freed with the IO
+  mutable Arena arena;
   mutable std::unordered_map<std::string, genlib_gate> gate_types;
-  mutable std::unordered_map<uint64_t, std::string> block_id_to_inst_name;
-  mutable std::unordered_map<uint64_t, genlib_gate> block_id_to_gate_type;
-  mutable std::unordered_map<std::string, uint64_t> net_name_to_id;
+  mutable std::pmr::unordered_map<uint64_t, std::pmr::string>
+      block_id_to_inst_name;
+  mutable std::pmr::unordered_map<uint64_t, const genlib_gate *>
+      block_id_to_gate_type;
+  mutable std::pmr::unordered_map<std::pmr::string, uint64_t, string_hash,
+                                  std::equal_to<>>
+      net_name_to_id;
+  // Reused for every instantiated module, add_block() doesn't keep the net ids
+  mutable block new_block;
 
   // Find sides a and b where a <= b <= 3a
   const std::pair<uint32_t, uint32_t> find_best_sides(double area) const;
@@ -1,10 +1,80 @@
+#pragma once
+
+#include <cstddef>
 #include <cstdint>
-#include <stdint.h>
+#include <span>
+
+// The range [0, range) of Xoshiro256pp::bounded(). Rejecting the biased
+// numbers needs 2^64 % range, the only division of the method, so it is
+// computed once here and the range is reused for many numbers
+struct bounded_range {
+  explicit constexpr bounded_range(uint64_t range)
+      : range(range), threshold(range == 0 ? 0 : (0 - range) % range) {}
+
+  uint64_t range;
+  uint64_t threshold;
+};
+
+// xoshiro256++ by David Blackman and Sebastiano Vigna. The state lives in the
+// object, so every annealer or thread can own a generator without locking.
+// A copy continues the same stream. jump() and long_jump() move the stream
+// ahead by 2^128 and 2^192 numbers, so generators derived from one seed with
+// them don't overlap. Meets UniformRandomBitGenerator, so it also works with
+// the <random> distributions
+class Xoshiro256pp {
+public:
+  typedef uint64_t result_type;
+
+  // Expands the seed into the state with splitmix64, as recommended by the
+  // authors
+  explicit Xoshiro256pp(uint64_t seed = 0);
+  Xoshiro256pp(uint64_t a, uint64_t b, uint64_t c, uint64_t d);
+
+  uint64_t next() {
+    const uint64_t result = rotl(s[0] + s[3], 23) + s[0];
+    const uint64_t t = s[1] << 17;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+
+    s[2] ^= t;
+    s[3] = rotl(s[3], 45);
+    return result;
+  }
+
+  uint64_t operator()() { return next(); }
+  static constexpr uint64_t min() { return 0; }
+  static constexpr uint64_t max() { return UINT64_MAX; }
+
+  // Uniform number in [0, r.range) with Lemire's multiply-shift method. The
+  // result is the high half of next() * range. Numbers whose low half is below
+  // the threshold would make some results more likely and are drawn again,
+  // which happens with a chance of range / 2^64
+  uint64_t bounded(const bounded_range &r) {
+    unsigned __int128 m = static_cast<unsigned __int128>(next()) * r.range;
+    while (static_cast<uint64_t>(m) < r.threshold) {
+      m = static_cast<unsigned __int128>(next()) * r.range;
+    }
+    return static_cast<uint64_t>(m >> 64);
+  }
 
-void xo_init_state(uint64_t a, uint64_t b, uint64_t c, uint64_t d);
+  // Writes the next out.size() numbers of the stream, the same ones next()
+  // would return
+  void fill(std::span<uint64_t> out);
 
-uint64_t xo_next(void);
+  // Equivalent to 2^128 calls to next(). Gives 2^128 non-overlapping streams
+  void jump();
+  // Equivalent to 2^192 calls to next(). Gives 2^64 starting points, each of
+  // which can be split with jump()
+  void long_jump();
 
-void xo_jump(void);
+private:
+  static uint64_t rotl(const uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+  }
+  void jump(const uint64_t (&polynomial)[4]);
 
-void xo_long_jump(void);
+  uint64_t s[4];
+};
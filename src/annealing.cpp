@@ -1,64 +1,195 @@
 #include "../include/annealing.h"
+#include "../include/cpu.h"
 #include "../include/debug.h"
 #include "../include/panic.h"
+#include "powv_tables.inc"
 #include <algorithm>
+#include <atomic>
+#include <barrier>
+#include <bit>
+#include <chrono>
 #include <cstddef>
+#include <cmath>
 #include <cstdint>
-#include <functional>
-#include <random>
+#include <deque>
+#include <immintrin.h>
+#include <string>
+#include <thread>
 #include <tuple>
 #include <vector>
 
+// Nets with at least this many pins use the AVX2 kernels
+#define AVX2_MIN_PINS 16
+// Smaller nets are cheaper to evaluate again than to track in hpwl_cost
+#define HPWL_BOX_MIN_PINS 8
+// Full cost evaluations only use another thread for this many pins
+#define PARALLEL_MIN_PINS 16384
+// Batches of anneal_speculative() only use the other threads if each of them
+// gets this many moves, smaller ones are evaluated by the main thread alone
+#define SPECULATIVE_MIN_SHARE 4
+
+// Read by every thread that evaluates a full cost
+static std::atomic<uint32_t> cost_threads =
+    std::max<uint32_t>(std::thread::hardware_concurrency(), 1);
+
+void set_cost_threads(uint32_t threads) {
+  cost_threads.store(std::max<uint32_t>(threads, 1),
+                     std::memory_order_relaxed);
+}
+
+// Sums range_cost(data, begin, end) over all nets. The nets are split into
+// chunks with about the same number of pins, so a few large nets don't keep
+// the other threads waiting. Integer sums don't depend on the order, so the
+// result is the same as the serial sum
+template <class F> static uint64_t sum_nets(Data &data, F range_cost) {
+  // The threads only read the pins
+  data.update_pins();
+  size_t total = 0;
+  for (size_t i = 0; i < data.num_nets; i++) {
+    total += data.get_pins(i).size;
+  }
+  size_t threads =
+      std::min<size_t>(cost_threads.load(std::memory_order_relaxed),
+                       total / PARALLEL_MIN_PINS);
+  if (threads <= 1) {
+    return range_cost(data, 0, data.num_nets);
+  }
+
+  std::vector<size_t> bounds = {0};
+  size_t pins = 0;
+  for (size_t i = 0; i < data.num_nets && bounds.size() < threads; i++) {
+    pins += data.get_pins(i).size;
+    if (pins >= bounds.size() * total / threads) {
+      bounds.push_back(i + 1);
+    }
+  }
+  bounds.push_back(data.num_nets);
+
+  std::vector<uint64_t> partial(bounds.size() - 1);
+  std::vector<std::thread> workers;
+  for (size_t c = 1; c + 1 < bounds.size(); c++) {
+    workers.emplace_back([&, c] {
+      partial[c] = range_cost(data, bounds[c], bounds[c + 1]);
+    });
+  }
+  partial[0] = range_cost(data, bounds[0], bounds[1]);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  uint64_t cost = 0;
+  for (uint64_t p : partial) {
+    cost += p;
+  }
+  return cost;
+}
+
+void log_net_degrees(Data &data, uint64_t (*cost_fn)(const pin_span &)) {
+  // Bucket b > 0 holds the degrees (2^(b-1), 2^b]
+  std::vector<std::vector<size_t>> buckets;
+  for (size_t i = 0; i < data.num_nets; i++) {
+    size_t degree = data.get_pins(i).size;
+    size_t b = degree <= 1 ? 0 : std::bit_width(degree - 1);
+    if (b >= buckets.size()) {
+      buckets.resize(b + 1);
+    }
+    buckets[b].push_back(i);
+  }
+
+  std::vector<uint64_t> costs(buckets.size(), 0);
+  std::vector<uint64_t> pins(buckets.size(), 0);
+  std::vector<double> seconds(buckets.size(), 0);
+  uint64_t total_cost = 0;
+  double total_seconds = 0;
+  for (size_t b = 0; b < buckets.size(); b++) {
+    for (size_t i : buckets[b]) {
+      pins[b] += data.get_pins(i).size;
+    }
+    // Evaluate small buckets several times, so the clock can resolve them
+    uint64_t rounds = std::max<uint64_t>(1, 100'000 / (pins[b] + 1));
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t r = 0; r < rounds; r++) {
+      uint64_t cost = 0;
+      for (size_t i : buckets[b]) {
+        cost += cost_fn(data.get_pins(i));
+      }
+      costs[b] = cost;
+    }
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    seconds[b] = elapsed.count() / rounds;
+    total_cost += costs[b];
+    total_seconds += seconds[b];
+  }
+
+  for (size_t b = 0; b < buckets.size(); b++) {
+    if (buckets[b].empty()) {
+      continue;
+    }
+    size_t low = b == 0 ? 0 : (size_t(1) << (b - 1)) + 1;
+    size_t high = b == 0 ? 1 : size_t(1) << b;
+    std::string degrees = low == high ? std::to_string(low)
+                                      : std::to_string(low) + "-" +
+                                            std::to_string(high);
+    LOG_INFO("Degree ", degrees, ": ", buckets[b].size(), " nets, ", pins[b],
+             " pins, ", 100 * costs[b] / std::max<uint64_t>(total_cost, 1),
+             "% of the cost, ",
+             static_cast<uint64_t>(1e9 * seconds[b] / buckets[b].size()),
+             " ns per net, ",
+             static_cast<uint64_t>(100 * seconds[b] /
+                                   std::max(total_seconds, 1e-12)),
+             "% of the evaluation time")
+  }
+}
+
+move_ranges::move_ranges(const Data &data, uint32_t window_x,
+                         uint32_t window_y)
+    : moves(LAST), blocks(data.num_blocks), shift_x(2 * uint64_t{window_x} + 1),
+      shift_y(2 * uint64_t{window_y} + 1), window_x(window_x),
+      window_y(window_y) {}
+
 // Select a random move. If the move is a shift, it will be in the range
 // [-window, window]
 // NOTE: window_x and window_y should be smaller than INT32_MAX and larger than
 // INT32_MIN, but that should not be an issue in real life use cases. Even if
 // one unit represents one nanometer. INT32_MAX would be over 2 meters.
-bool try_random_move(Data &data, uint32_t window_x, uint32_t window_y) {
-  // Select move
-  move move = static_cast<enum move>(xo_next() % LAST);
-  uint64_t range;
-  int32_t x_move;
-  int32_t y_move;
-
-  switch (move) {
-  case SHIFT: {
-    block &b = data.get_block_by_index(xo_next() % data.num_blocks);
-    range = 2 * window_x + 1;
-    x_move = static_cast<int32_t>((xo_next() % range)) -
-             static_cast<int32_t>(window_x);
-    range = 2 * window_y + 1;
-    y_move = static_cast<int32_t>((xo_next() % range)) -
-             static_cast<int32_t>(window_y);
-    DEBUG("Try shift of block ", b.id, " with x ", x_move, " y ", y_move)
-    return data.try_shift(b, x_move, y_move);
+move_proposal draw_move(Xoshiro256pp &rng, const move_ranges &ranges) {
+  move_proposal m = {static_cast<enum move>(rng.bounded(ranges.moves)), 0, 0,
+                     0, 0};
+  m.block = rng.bounded(ranges.blocks);
+  if (m.type == SHIFT) {
+    m.x = static_cast<int32_t>(rng.bounded(ranges.shift_x)) -
+          static_cast<int32_t>(ranges.window_x);
+    m.y = static_cast<int32_t>(rng.bounded(ranges.shift_y)) -
+          static_cast<int32_t>(ranges.window_y);
+  } else if (m.type == SWAP) {
+    m.other = rng.bounded(ranges.blocks);
   }
+  return m;
+}
+
+bool make_move(Data &data, const move_proposal &m) {
+  block &b = data.get_block_by_index(m.block);
+  switch (m.type) {
+  case SHIFT:
+    DEBUG("Try shift of block ", b.id, " with x ", m.x, " y ", m.y)
+    return data.try_shift(b, m.x, m.y);
   case SWAP: {
-    block &b1 = data.get_block_by_index(xo_next() % data.num_blocks);
-    block &b2 = data.get_block_by_index(xo_next() % data.num_blocks);
-    DEBUG("Try swapping block ", b1.id, " and ", b2.id)
-    return data.try_swap(b1, b2);
+    block &other = data.get_block_by_index(m.other);
+    DEBUG("Try swapping block ", b.id, " and ", other.id)
+    return data.try_swap(b, other);
   }
-  case FLIP_H: {
-    block &b = data.get_block_by_index(xo_next() % data.num_blocks);
+  case FLIP_H:
     DEBUG("Try flip_h block ", b.id)
     return data.try_flip_h(b);
-  }
-  case FLIP_V: {
-    block &b = data.get_block_by_index(xo_next() % data.num_blocks);
+  case FLIP_V:
     DEBUG("Try flip_v block ", b.id)
     return data.try_flip_v(b);
-  }
-  case ROT_CW: {
-    block &b = data.get_block_by_index(xo_next() % data.num_blocks);
+  case ROT_CW:
     DEBUG("Try rot_cw block ", b.id)
     return data.try_rot_cw(b);
-  }
-  case ROT_CC: {
-    block &b = data.get_block_by_index(xo_next() % data.num_blocks);
+  case ROT_CC:
     DEBUG("Try rot_cc block ", b.id)
     return data.try_rot_cc(b);
-  }
   default:
     // How?
     panic("Somehow a non-existing type of move was selected");
@@ -66,25 +197,42 @@ bool try_random_move(Data &data, uint32_t window_x, uint32_t window_y) {
   }
 }
 
-uint64_t mcl_net(net &net) {
-  if (net.pins.size() <= 1) {
+bool try_random_move(Data &data, Xoshiro256pp &rng,
+                     const move_ranges &ranges) {
+  return make_move(data, draw_move(rng, ranges));
+}
+
+bool try_random_move(Data &data, Xoshiro256pp &rng, uint32_t window_x,
+                     uint32_t window_y) {
+  return try_random_move(data, rng, move_ranges(data, window_x, window_y));
+}
+
+// Range of the acceptance test of worse costs
+static constexpr bounded_range temp_range(MAX_TEMP);
+
+uint64_t mcl_net(const pin_span &pins) {
+  if (pins.size <= 1) {
     return 0;
   }
 
-  std::sort(net.pins.begin(), net.pins.end(),
-            [](std::tuple<uint64_t, uint32_t, uint32_t> &a,
-               std::tuple<uint64_t, uint32_t, uint32_t> &b) {
-              return std::get<1>(a) < std::get<1>(b);
-            });
+  // NOTE: Sort a copy. Reordering the pins would move the star root away from
+  // pins[0]
+  static thread_local std::vector<std::pair<uint32_t, uint32_t>> sorted;
+  sorted.clear();
+  for (size_t i = 0; i < pins.size; i++) {
+    sorted.emplace_back(pins.x[i], pins.y[i]);
+  }
+  // Sorting by y as well makes the cost independent of the pin order
+  std::sort(sorted.begin(), sorted.end());
   uint64_t cost = 0;
-  uint32_t current_x = get<1>(net.pins[0]);
-  uint32_t current_y = get<2>(net.pins[0]);
+  uint32_t current_x = sorted[0].first;
+  uint32_t current_y = sorted[0].second;
   uint32_t x;
   uint32_t y;
 
-  for (size_t i = 1; i < net.pins.size(); i++) {
-    x = std::get<1>(net.pins[i]);
-    y = std::get<2>(net.pins[i]);
+  for (size_t i = 1; i < sorted.size(); i++) {
+    x = sorted[i].first;
+    y = sorted[i].second;
     cost += (x > current_x) ? (x - current_x) : (current_x - x);
     cost += (y > current_y) ? (y - current_y) : (current_y - y);
     current_x = x;
@@ -94,208 +242,842 @@ uint64_t mcl_net(net &net) {
 }
 
 uint64_t mcl(Data &data) {
+  return sum_nets(data, [](Data &data, size_t begin, size_t end) {
+    uint64_t cost = 0;
+    for (size_t i = begin; i < end; i++) {
+      cost += mcl_net(data.get_pins(i));
+    }
+    return cost;
+  });
+}
+
+static inline uint64_t distance(const pin_span &pins, size_t a, size_t b) {
+  uint32_t dx = pins.x[a] > pins.x[b] ? pins.x[a] - pins.x[b]
+                                      : pins.x[b] - pins.x[a];
+  uint32_t dy = pins.y[a] > pins.y[b] ? pins.y[a] - pins.y[b]
+                                      : pins.y[b] - pins.y[a];
+  return uint64_t{dx} + dy;
+}
+
+// Chain order of two pins of the same net. The slot makes the order unique
+static inline bool chain_less(const pin_span &pins, size_t a, size_t b) {
+  return std::tie(pins.x[a], pins.y[a], a) < std::tie(pins.x[b], pins.y[b], b);
+}
+
+void mcl_cost::reset(size_t num_nets) {
+  begin.assign(num_nets, 0);
+  order.clear();
+  position.clear();
+  costs.assign(num_nets, 0);
+}
+
+uint64_t mcl_cost::init_net(size_t net_index, const pin_span &pins) {
+  // Skipped nets never get here, so the nets don't come in one after the other
+  begin[net_index] = order.size();
+  order.resize(order.size() + pins.size);
+  position.resize(order.size());
+  uint32_t *o = order.data() + begin[net_index];
+  for (size_t i = 0; i < pins.size; i++) {
+    o[i] = i;
+  }
+  std::sort(o, o + pins.size,
+            [&](uint32_t a, uint32_t b) { return chain_less(pins, a, b); });
   uint64_t cost = 0;
-  for (size_t i = 0; i < data.num_nets; i++) {
-    cost += mcl_net(data.get_net_by_index(i));
+  for (size_t i = 0; i < pins.size; i++) {
+    position[begin[net_index] + o[i]] = i;
+    if (i > 0) {
+      cost += distance(pins, o[i - 1], o[i]);
+    }
+  }
+  costs[net_index] = cost;
+  return cost;
+}
+
+void mcl_cost::move_pin(size_t net_index, const pin_span &pins, size_t slot,
+                        uint32_t old_x, uint32_t old_y) {
+  uint32_t *o = order.data() + begin[net_index];
+  uint32_t *pos = position.data() + begin[net_index];
+  size_t last = pins.size - 1;
+  size_t p = pos[slot];
+  uint64_t cost = costs[net_index];
+
+  // Take the pin out of the chain with its old position
+  auto old_distance = [&](size_t other) {
+    uint32_t dx = old_x > pins.x[other] ? old_x - pins.x[other]
+                                        : pins.x[other] - old_x;
+    uint32_t dy = old_y > pins.y[other] ? old_y - pins.y[other]
+                                        : pins.y[other] - old_y;
+    return uint64_t{dx} + dy;
+  };
+  if (p > 0) {
+    cost -= old_distance(o[p - 1]);
+  }
+  if (p < last) {
+    cost -= old_distance(o[p + 1]);
+  }
+  if (p > 0 && p < last) {
+    cost += distance(pins, o[p - 1], o[p + 1]);
+  }
+
+  // Shift the pins between the old and the new place by one
+  while (p > 0 && chain_less(pins, slot, o[p - 1])) {
+    o[p] = o[p - 1];
+    pos[o[p]] = p;
+    p--;
+  }
+  while (p < last && chain_less(pins, o[p + 1], slot)) {
+    o[p] = o[p + 1];
+    pos[o[p]] = p;
+    p++;
+  }
+  o[p] = slot;
+  pos[slot] = p;
+
+  // Insert it again with the new position
+  if (p > 0 && p < last) {
+    cost -= distance(pins, o[p - 1], o[p + 1]);
+  }
+  if (p > 0) {
+    cost += distance(pins, o[p - 1], slot);
+  }
+  if (p < last) {
+    cost += distance(pins, slot, o[p + 1]);
+  }
+  costs[net_index] = cost;
+}
+
+uint64_t mcl_cost::net_cost(size_t net_index, const pin_span &pins) {
+  return costs[net_index];
+}
+
+__attribute__((target("avx2"))) static uint64_t
+star_sum_avx2(const pin_span &pins, uint32_t root_x, uint32_t root_y) {
+  __m256i r_x = _mm256_set1_epi32(root_x);
+  __m256i r_y = _mm256_set1_epi32(root_y);
+  __m256i sum = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 8 <= pins.size; i += 8) {
+    __m256i x =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pins.x + i));
+    __m256i y =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pins.y + i));
+    // |a - b| is max(a, b) - min(a, b) for unsigned values
+    __m256i dx = _mm256_sub_epi32(_mm256_max_epu32(x, r_x),
+                                  _mm256_min_epu32(x, r_x));
+    __m256i dy = _mm256_sub_epi32(_mm256_max_epu32(y, r_y),
+                                  _mm256_min_epu32(y, r_y));
+    // Widen to 64 bit before adding, so large nets can't overflow
+    sum = _mm256_add_epi64(
+        sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(dx)));
+    sum = _mm256_add_epi64(
+        sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(dx, 1)));
+    sum = _mm256_add_epi64(
+        sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(dy)));
+    sum = _mm256_add_epi64(
+        sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(dy, 1)));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i *>(lanes), sum);
+  uint64_t cost = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  for (; i < pins.size; i++) {
+    cost += (pins.x[i] > root_x) ? (pins.x[i] - root_x) : (root_x - pins.x[i]);
+    cost += (pins.y[i] > root_y) ? (pins.y[i] - root_y) : (root_y - pins.y[i]);
   }
   return cost;
 }
 
-uint64_t star_net(net &net) {
-  if (net.pins.size() <= 1) {
+uint64_t star_net(const pin_span &pins) {
+  if (pins.size <= 1) {
     return 0;
   }
+  uint32_t root_x = pins.x[0];
+  uint32_t root_y = pins.y[0];
+  // The root adds nothing to the sum
+  if (has_avx2 && pins.size >= AVX2_MIN_PINS) {
+    return star_sum_avx2(pins, root_x, root_y);
+  }
   uint64_t cost = 0;
-  uint32_t root_x = std::get<1>(net.pins[0]);
-  uint32_t root_y = std::get<2>(net.pins[0]);
   uint32_t x;
   uint32_t y;
 
-  for (size_t i = 1; i < net.pins.size(); i++) {
-    x = std::get<1>(net.pins[i]);
-    y = std::get<2>(net.pins[i]);
+  for (size_t i = 1; i < pins.size; i++) {
+    x = pins.x[i];
+    y = pins.y[i];
     cost += (x > root_x) ? (x - root_x) : (root_x - x);
     cost += (y > root_y) ? (y - root_y) : (root_y - y);
   }
   return cost;
 }
 
+void star_cost::reset(size_t num_nets) { stars.assign(num_nets, {0, false}); }
+
+uint64_t star_cost::init_net(size_t net_index, const pin_span &pins) {
+  stars[net_index] = {star_net(pins), false};
+  return stars[net_index].sum;
+}
+
+void star_cost::move_pin(size_t net_index, const pin_span &pins, size_t slot,
+                         uint32_t old_x, uint32_t old_y) {
+  star &s = stars[net_index];
+  if (slot == 0) {
+    s.stale = true;
+    return;
+  }
+  if (s.stale) {
+    return;
+  }
+  uint32_t root_x = pins.x[0];
+  uint32_t root_y = pins.y[0];
+  uint32_t x = pins.x[slot];
+  uint32_t y = pins.y[slot];
+  s.sum -= (old_x > root_x) ? (old_x - root_x) : (root_x - old_x);
+  s.sum -= (old_y > root_y) ? (old_y - root_y) : (root_y - old_y);
+  s.sum += (x > root_x) ? (x - root_x) : (root_x - x);
+  s.sum += (y > root_y) ? (y - root_y) : (root_y - y);
+}
+
+uint64_t star_cost::net_cost(size_t net_index, const pin_span &pins) {
+  if (stars[net_index].stale) {
+    return init_net(net_index, pins);
+  }
+  return stars[net_index].sum;
+}
+
 uint64_t star(Data &data) {
-  uint64_t cost = 0;
-  for (size_t i = 0; i < data.num_nets; i++) {
-    cost += star_net(data.get_net_by_index(i));
+  return sum_nets(data, [](Data &data, size_t begin, size_t end) {
+    uint64_t cost = 0;
+    for (size_t i = begin; i < end; i++) {
+      cost += star_net(data.get_pins(i));
+    }
+    return cost;
+  });
+}
+
+// Bounding box of the pins [begin, end)
+static inline void bbox_scalar(const pin_span &pins, size_t begin, size_t end,
+                               uint32_t &min_x, uint32_t &max_x,
+                               uint32_t &min_y, uint32_t &max_y) {
+  for (size_t i = begin; i < end; i++) {
+    min_x = std::min(min_x, pins.x[i]);
+    max_x = std::max(max_x, pins.x[i]);
+    min_y = std::min(min_y, pins.y[i]);
+    max_y = std::max(max_y, pins.y[i]);
   }
-  return cost;
 }
 
-uint64_t hpwl_net(net &net) {
+__attribute__((target("avx2"))) static inline uint32_t
+reduce_min_avx2(__m256i v) {
+  __m128i m = _mm_min_epu32(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  m = _mm_min_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+  m = _mm_min_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(m);
+}
+
+__attribute__((target("avx2"))) static inline uint32_t
+reduce_max_avx2(__m256i v) {
+  __m128i m = _mm_max_epu32(_mm256_castsi256_si128(v),
+                            _mm256_extracti128_si256(v, 1));
+  m = _mm_max_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(1, 0, 3, 2)));
+  m = _mm_max_epu32(m, _mm_shuffle_epi32(m, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(m);
+}
+
+// Expects at least 8 pins
+__attribute__((target("avx2"))) static uint64_t
+hpwl_avx2(const pin_span &pins) {
+  __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pins.x));
+  __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pins.y));
+  __m256i min_x = x;
+  __m256i max_x = x;
+  __m256i min_y = y;
+  __m256i max_y = y;
+  size_t i = 8;
+  for (; i + 8 <= pins.size; i += 8) {
+    x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pins.x + i));
+    y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pins.y + i));
+    min_x = _mm256_min_epu32(min_x, x);
+    max_x = _mm256_max_epu32(max_x, x);
+    min_y = _mm256_min_epu32(min_y, y);
+    max_y = _mm256_max_epu32(max_y, y);
+  }
+  uint32_t n_min_x = reduce_min_avx2(min_x);
+  uint32_t n_max_x = reduce_max_avx2(max_x);
+  uint32_t n_min_y = reduce_min_avx2(min_y);
+  uint32_t n_max_y = reduce_max_avx2(max_y);
+  bbox_scalar(pins, i, pins.size, n_min_x, n_max_x, n_min_y, n_max_y);
+  return (n_max_x - n_min_x) + (n_max_y - n_min_y);
+}
+
+static inline uint64_t hpwl_2(const pin_span &pins) {
+  uint32_t dx = pins.x[0] > pins.x[1] ? pins.x[0] - pins.x[1]
+                                      : pins.x[1] - pins.x[0];
+  uint32_t dy = pins.y[0] > pins.y[1] ? pins.y[0] - pins.y[1]
+                                      : pins.y[1] - pins.y[0];
+  return dx + dy;
+}
 
-  if (net.pins.size() <= 1) {
+static inline uint64_t hpwl_3(const pin_span &pins) {
+  const uint32_t *x = pins.x;
+  const uint32_t *y = pins.y;
+  return (std::max({x[0], x[1], x[2]}) - std::min({x[0], x[1], x[2]})) +
+         (std::max({y[0], y[1], y[2]}) - std::min({y[0], y[1], y[2]}));
+}
+
+static inline uint64_t hpwl_4(const pin_span &pins) {
+  const uint32_t *x = pins.x;
+  const uint32_t *y = pins.y;
+  return (std::max(std::max(x[0], x[1]), std::max(x[2], x[3])) -
+          std::min(std::min(x[0], x[1]), std::min(x[2], x[3]))) +
+         (std::max(std::max(y[0], y[1]), std::max(y[2], y[3])) -
+          std::min(std::min(y[0], y[1]), std::min(y[2], y[3])));
+}
+
+// Any number of pins
+static inline uint64_t hpwl_n(const pin_span &pins) {
+  if (pins.size <= 1) {
     // Weird net, but ok
     return 0;
   }
-
+  if (has_avx2 && pins.size >= AVX2_MIN_PINS) {
+    return hpwl_avx2(pins);
+  }
   uint32_t min_x = UINT32_MAX;
   uint32_t max_x = 0;
   uint32_t min_y = UINT32_MAX;
   uint32_t max_y = 0;
+  bbox_scalar(pins, 0, pins.size, min_x, max_x, min_y, max_y);
+  return (max_x - min_x) + (max_y - min_y);
+}
 
-  for (size_t i = 0; i < net.pins.size(); i++) {
-    auto [id, n_x, n_y] = net.pins[i];
-    min_x = (n_x < min_x) ? n_x : min_x;
-    max_x = (n_x > max_x) ? n_x : max_x;
-    min_y = (n_y < min_y) ? n_y : min_y;
-    max_y = (n_y > max_y) ? n_y : max_y;
+uint64_t hpwl_net(const pin_span &pins) {
+  // Most nets have 2 to 4 pins
+  switch (pins.size) {
+  case 2:
+    return hpwl_2(pins);
+  case 3:
+    return hpwl_3(pins);
+  case 4:
+    return hpwl_4(pins);
+  default:
+    return hpwl_n(pins);
   }
-  return (max_x - min_x) + (max_y - min_y);
 }
 
-uint64_t hpwl(Data &data) {
+// hpwl() of the nets [begin, end)
+static uint64_t hpwl_range(Data &data, size_t begin, size_t end) {
+  // Evaluate the nets grouped by degree, so every group runs one kernel
+  // without branching on the size of each net. The buckets are sorted, so the
+  // nets of [begin, end) are one part of each
   uint64_t cost = 0;
-  for (size_t i = 0; i < data.num_nets; i++) {
-    cost += hpwl_net(data.get_net_by_index(i));
-  }
+  auto sum_bucket = [&](size_t bucket, auto kernel) {
+    const std::vector<size_t> &nets = data.get_degree_bucket(bucket);
+    auto first = std::lower_bound(nets.begin(), nets.end(), begin);
+    auto last = std::lower_bound(first, nets.end(), end);
+    for (; first != last; first++) {
+      cost += kernel(data.get_pins(*first));
+    }
+  };
+  sum_bucket(0, [](const pin_span &pins) { return hpwl_2(pins); });
+  sum_bucket(1, [](const pin_span &pins) { return hpwl_3(pins); });
+  sum_bucket(2, [](const pin_span &pins) { return hpwl_4(pins); });
+  sum_bucket(3, [](const pin_span &pins) { return hpwl_n(pins); });
   return cost;
 }
 
-uint64_t anneal(Data &data, std::function<uint64_t(Data &)> cost_fn,
-                uint64_t initial_temp, uint64_t final_temp,
-                uint32_t initial_window_x, uint32_t final_window_x,
-                uint32_t initial_window_y, uint32_t final_window_y,
-                uint64_t steps, uint64_t warmup_steps, uint64_t tuning_steps,
-                uint32_t initial_moves_per_step, uint32_t final_moves_per_step,
-                bool logging_enabled, struct log logger) {
+uint64_t hpwl(Data &data) { return sum_nets(data, hpwl_range); }
 
-  // Initialize random number gen
-  std::random_device rd;
-  std::mt19937_64 init(rd());
+// Adds a pin at pos to one dimension of a box
+static inline void add_edges(uint32_t &min, uint32_t &max, uint32_t &on_min,
+                             uint32_t &on_max, uint32_t pos) {
+  if (pos < min) {
+    min = pos;
+    on_min = 1;
+  } else {
+    on_min += pos == min;
+  }
+  if (pos > max) {
+    max = pos;
+    on_max = 1;
+  } else {
+    on_max += pos == max;
+  }
+}
 
-  xo_init_state(init(), init(), init(), init());
+// Moves a pin of one dimension of a box from old_pos to pos. Returns false if
+// an edge has no pins left
+static inline bool move_edges(uint32_t &min, uint32_t &max, uint32_t &on_min,
+                              uint32_t &on_max, uint32_t old_pos,
+                              uint32_t pos) {
+  on_min -= old_pos == min;
+  on_max -= old_pos == max;
+  add_edges(min, max, on_min, on_max, pos);
+  return on_min > 0 && on_max > 0;
+}
 
-  uint64_t cost;
-  uint64_t current_cost = cost_fn(data);
-  uint64_t best_cost = current_cost;
-  data.save_best();
-  uint64_t temp = initial_temp;
-  uint32_t window_x = initial_window_x;
-  uint32_t window_y = initial_window_y;
-  uint32_t moves_per_step = initial_moves_per_step;
-
-  uint64_t temp_reduction_interval = (steps / (initial_temp - final_temp)) > 0
-                                         ? steps / (initial_temp - final_temp)
-                                         : 1;
-  uint64_t temp_reduction_counter = temp_reduction_interval;
-  uint64_t temp_reduction_amount = ((initial_temp - final_temp) / steps) > 0
-                                       ? ((initial_temp - final_temp) / steps)
-                                       : 1;
-
-  uint64_t window_x_reduction_interval =
-      (steps / (initial_window_x - final_window_x)) > 0
-          ? (steps / (initial_window_x - final_window_x))
-          : 1;
-  uint64_t window_x_reduction_counter = window_x_reduction_interval;
-  uint64_t window_x_reduction_amount =
-      ((initial_window_x - final_window_x) / steps) > 0
-          ? ((initial_window_x - final_window_x) / steps)
-          : 1;
-
-  uint64_t window_y_reduction_interval =
-      (steps / (initial_window_y - final_window_y)) > 0
-          ? (steps / (initial_window_y - final_window_y))
-          : 1;
-  uint64_t window_y_reduction_counter = window_y_reduction_interval;
-  uint64_t window_y_reduction_amount =
-      ((initial_window_y - final_window_y) / steps) > 0
-          ? ((initial_window_y - final_window_y) / steps)
-          : 1;
-
-  uint64_t move_reduction_interval =
-      (steps / (initial_moves_per_step - final_moves_per_step)) > 0
-          ? (steps / (initial_moves_per_step - final_moves_per_step))
-          : 1;
-  uint64_t move_reduction_counter = move_reduction_interval;
-  uint64_t move_reduction_amount =
-      ((initial_moves_per_step - final_moves_per_step) / steps) > 0
-          ? ((initial_moves_per_step - final_moves_per_step) / steps)
-          : 1;
+void hpwl_cost::reset(size_t num_nets) { boxes.assign(num_nets, {}); }
 
-  uint64_t logging_counter = logger.interval > 0 ? logger.interval : 1;
+// Scans all pins of a net into b. Returns false for a net without pins
+static bool init_box(net_box &b, const pin_span &pins) {
+  b = {UINT32_MAX, 0, UINT32_MAX, 0, 0, 0, 0, 0, false};
+  if (pins.size == 0) {
+    return false;
+  }
+  for (size_t i = 0; i < pins.size; i++) {
+    add_edges(b.min_x, b.max_x, b.on_min_x, b.on_max_x, pins.x[i]);
+    add_edges(b.min_y, b.max_y, b.on_min_y, b.on_max_y, pins.y[i]);
+  }
+  return true;
+}
 
-  DEBUG("Finished initialization. Starting main loop")
-  DEBUG("Initial temperature: ", temp)
-  DEBUG("Final temperature: ", final_temp)
-  DEBUG("Temperature reduction interval: ", temp_reduction_interval)
-  DEBUG("Temperature reduction amount: ", temp_reduction_amount)
+// Moves the pin in slot of a box from old_x and old_y to its current position.
+// Returns false if an edge has no pins left
+static inline bool move_box(net_box &b, const pin_span &pins, size_t slot,
+                            uint32_t old_x, uint32_t old_y) {
+  bool x_ok = move_edges(b.min_x, b.max_x, b.on_min_x, b.on_max_x, old_x,
+                         pins.x[slot]);
+  bool y_ok = move_edges(b.min_y, b.max_y, b.on_min_y, b.on_max_y, old_y,
+                         pins.y[slot]);
+  return x_ok && y_ok;
+}
 
-  DEBUG("Initial window x: ", window_x)
-  DEBUG("Final window x: ", final_window_x)
-  DEBUG("window x reduction interval: ", window_x_reduction_interval)
-  DEBUG("window x reduction amount: ", window_x_reduction_amount)
+uint64_t hpwl_cost::init_net(size_t net_index, const pin_span &pins) {
+  net_box &b = boxes[net_index];
+  if (!init_box(b, pins)) {
+    return 0;
+  }
+  return (b.max_x - b.min_x) + (b.max_y - b.min_y);
+}
 
-  DEBUG("Initial window y: ", window_y)
-  DEBUG("Final window y: ", final_window_y)
-  DEBUG("window y reduction interval: ", window_y_reduction_interval)
-  DEBUG("window y reduction amount: ", window_y_reduction_amount)
+void hpwl_cost::move_pin(size_t net_index, const pin_span &pins, size_t slot,
+                         uint32_t old_x, uint32_t old_y) {
+  net_box &b = boxes[net_index];
+  if (b.stale || pins.size < HPWL_BOX_MIN_PINS) {
+    return;
+  }
+  b.stale = !move_box(b, pins, slot, old_x, old_y);
+}
 
-  DEBUG("Initial moves per step: ", initial_moves_per_step)
-  DEBUG("Final moves per step: ", final_moves_per_step)
-  DEBUG("Move reduction interval: ", move_reduction_interval)
-  DEBUG("Move reduction amount: ", move_reduction_amount)
+uint64_t hpwl_cost::net_cost(size_t net_index, const pin_span &pins) {
+  net_box &b = boxes[net_index];
+  if (pins.size < HPWL_BOX_MIN_PINS) {
+    return hpwl_net(pins);
+  }
+  if (b.stale) {
+    return init_net(net_index, pins);
+  }
+  return (b.max_x - b.min_x) + (b.max_y - b.min_y);
+}
 
-  for (uint64_t i = 0; i < steps; i++) {
+// Looks the net up in the tables of powv_gen
+static uint64_t rsmt_table(const pin_span &pins) {
+  size_t n = pins.size;
+  // Pin slots sorted by x, then y
+  uint32_t by_x[POWV_MAX_DEGREE];
+  for (size_t i = 0; i < n; i++) {
+    size_t j = i;
+    for (; j > 0 && std::pair(pins.x[by_x[j - 1]], pins.y[by_x[j - 1]]) >
+                        std::pair(pins.x[i], pins.y[i]);
+         j--) {
+      by_x[j] = by_x[j - 1];
+    }
+    by_x[j] = i;
+  }
+  // Positions in x order sorted by y. Ties keep the x order
+  uint32_t by_y[POWV_MAX_DEGREE];
+  for (size_t i = 0; i < n; i++) {
+    size_t j = i;
+    for (; j > 0 && pins.y[by_x[by_y[j - 1]]] > pins.y[by_x[i]]; j--) {
+      by_y[j] = by_y[j - 1];
+    }
+    by_y[j] = i;
+  }
+  uint32_t rank[POWV_MAX_DEGREE];
+  for (size_t k = 0; k < n; k++) {
+    rank[by_y[k]] = k;
+  }
+  // Index of the permutation in lexicographic order
+  uint32_t index = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint32_t smaller = 0;
+    for (size_t j = i + 1; j < n; j++) {
+      smaller += rank[j] < rank[i];
+    }
+    index = index * (n - i) + smaller;
+  }
+  uint32_t gaps[2 * (POWV_MAX_DEGREE - 1)];
+  for (size_t i = 0; i + 1 < n; i++) {
+    gaps[i] = pins.x[by_x[i + 1]] - pins.x[by_x[i]];
+    gaps[n - 1 + i] = pins.y[by_x[by_y[i + 1]]] - pins.y[by_x[by_y[i]]];
+  }
 
-    // 1. Save state
-    data.save_state();
-    DEBUG("Saved state ")
+  size_t len = 2 * (n - 1);
+  const uint8_t *vector = powv[n] + powv_begin[n][index] * len;
+  const uint8_t *end = powv[n] + powv_begin[n][index + 1] * len;
+  uint64_t best = UINT64_MAX;
+  for (; vector < end; vector += len) {
+    uint64_t cost = 0;
+    for (size_t i = 0; i < len; i++) {
+      cost += vector[i] * gaps[i];
+    }
+    best = std::min(best, cost);
+  }
+  return best;
+}
 
-    // 2. Perform moves
-    uint64_t successful_moves = 0;
-    [[maybe_unused]]
-    uint64_t move_failures = 0;
-    while (successful_moves < moves_per_step) {
-      successful_moves += try_random_move(data, window_x, window_y) ? 1 : 0;
-      if (try_random_move(data, window_x, window_y)) {
-        successful_moves++;
-      } else {
-        move_failures++;
-      }
-      DEBUG(successful_moves, " Successful moves")
+// Sum of the distances of the coordinates to their median plus the span of
+// the other dimension. Length of a trunk through the median with a branch to
+// every pin
+static uint64_t trunk(const uint32_t *along, const uint32_t *across,
+                      size_t n) {
+  static thread_local std::vector<uint32_t> sorted;
+  sorted.assign(across, across + n);
+  std::nth_element(sorted.begin(), sorted.begin() + n / 2, sorted.end());
+  uint32_t median = sorted[n / 2];
+  uint32_t min = UINT32_MAX;
+  uint32_t max = 0;
+  uint64_t cost = 0;
+  for (size_t i = 0; i < n; i++) {
+    min = std::min(min, along[i]);
+    max = std::max(max, along[i]);
+    cost += across[i] > median ? across[i] - median : median - across[i];
+  }
+  return cost + (max - min);
+}
+
+uint64_t rsmt_net(const pin_span &pins) {
+  if (pins.size <= 1) {
+    return 0;
+  }
+  if (pins.size <= 3) {
+    // Steiner trees of up to three pins are as long as the half perimeter
+    return hpwl_net(pins);
+  }
+  if (pins.size <= POWV_MAX_DEGREE) {
+    return rsmt_table(pins);
+  }
+  return std::min(trunk(pins.x, pins.y, pins.size),
+                  trunk(pins.y, pins.x, pins.size));
+}
+
+uint64_t rsmt(Data &data) {
+  return sum_nets(data, [](Data &data, size_t begin, size_t end) {
+    uint64_t cost = 0;
+    for (size_t i = begin; i < end; i++) {
+      cost += rsmt_net(data.get_pins(i));
     }
-    DEBUG(move_failures, " move failures for ", successful_moves,
-          " successful moves")
+    return cost;
+  });
+}
 
-    // 3. Compute cost
+template <class Wirelength>
+rudy_cost<Wirelength>::rudy_cost(uint32_t chip_x, uint32_t chip_y,
+                                 uint64_t weight, uint32_t bin_size)
+    : weight(weight), bin_size(bin_size), demand_squared(0) {
+  if (bin_size == 0) {
+    panic("RUDY bin size has to be at least 1");
+  }
+  bins_x = chip_x / bin_size + 1;
+  bins_y = chip_y / bin_size + 1;
+}
 
-    DEBUG("Computing cost")
-    cost = cost_fn(data);
-    DEBUG("New cost: ", cost)
+template <class Wirelength>
+void rudy_cost<Wirelength>::reset(size_t num_nets) {
+  wirelength.reset(num_nets);
+  boxes.assign(num_nets, {});
+  spread_boxes.assign(num_nets, {});
+  pending.assign(num_nets, false);
+  pending_nets.clear();
+  demand.assign(bins_x * bins_y, 0);
+  demand_squared = 0;
+}
+
+template <class Wirelength>
+uint64_t rudy_cost<Wirelength>::init_net(size_t net_index,
+                                         const pin_span &pins) {
+  net_box &b = boxes[net_index];
+  if (init_box(b, pins)) {
+    spread(b, true);
+  }
+  spread_boxes[net_index] = b;
+  return wirelength.init_net(net_index, pins);
+}
 
+template <class Wirelength>
+void rudy_cost<Wirelength>::move_pin(size_t net_index, const pin_span &pins,
+                                     size_t slot, uint32_t old_x,
+                                     uint32_t old_y) {
+  wirelength.move_pin(net_index, pins, slot, old_x, old_y);
+  // Data writes the old pins again on a rollback without asking for the cost
+  // of their nets, so the bins are updated in global_cost() for every net
+  // whose pins moved
+  net_box &b = boxes[net_index];
+  if (!b.stale) {
+    b.stale = !move_box(b, pins, slot, old_x, old_y);
+  }
+  if (!pending[net_index]) {
+    pending[net_index] = true;
+    pending_nets.emplace_back(net_index, pins);
+  }
+}
+
+template <class Wirelength>
+uint64_t rudy_cost<Wirelength>::net_cost(size_t net_index,
+                                         const pin_span &pins) {
+  return wirelength.net_cost(net_index, pins);
+}
+
+template <class Wirelength> uint64_t rudy_cost<Wirelength>::global_cost() {
+  for (auto [i, pins] : pending_nets) {
+    net_box &b = boxes[i];
+    if (b.stale) {
+      init_box(b, pins);
+    }
+    net_box &old = spread_boxes[i];
+    if (b.min_x != old.min_x || b.max_x != old.max_x ||
+        b.min_y != old.min_y || b.max_y != old.max_y) {
+      spread(old, false);
+      spread(b, true);
+      old = b;
+    }
+    pending[i] = false;
+  }
+  pending_nets.clear();
+  return weight * demand_squared / (bin_size * bin_size);
+}
+
+template <class Wirelength>
+void rudy_cost<Wirelength>::spread(const net_box &b, bool add) {
+  // Both are at least 1, so a net with all pins on one row still has an area
+  uint64_t width = b.max_x - b.min_x + 1;
+  uint64_t height = b.max_y - b.min_y + 1;
+  uint64_t wire = (width - 1) + (height - 1);
+  if (wire == 0) {
+    return;
+  }
+  uint64_t area = width * height;
+  size_t first_x = b.min_x / bin_size;
+  size_t last_x = std::min<size_t>(b.max_x / bin_size, bins_x - 1);
+  size_t first_y = b.min_y / bin_size;
+  size_t last_y = std::min<size_t>(b.max_y / bin_size, bins_y - 1);
+  // Width of the box in the first, the inner and the last column of bins
+  uint64_t first_width =
+      std::min<uint64_t>(b.max_x + 1, (first_x + 1) * bin_size) - b.min_x;
+  uint64_t last_width = b.max_x + 1 - std::max<uint64_t>(b.min_x,
+                                                         last_x * bin_size);
+  for (size_t by = first_y; by <= last_y; by++) {
+    uint64_t top = std::max<uint64_t>(b.min_y, by * bin_size);
+    uint64_t bottom = std::min<uint64_t>(b.max_y + 1, (by + 1) * bin_size);
+    uint64_t row_wire = wire * (bottom - top);
+    // Always the same share for the same box, so removing it again restores
+    // the bins exactly. Only the outer columns are cut by the box
+    uint64_t first_share = row_wire * first_width / area;
+    uint64_t inner_share = row_wire * bin_size / area;
+    uint64_t last_share = row_wire * last_width / area;
+    uint64_t *row = &demand[by * bins_x];
+    for (size_t bx = first_x; bx <= last_x; bx++) {
+      uint64_t share = bx == first_x  ? first_share
+                       : bx == last_x ? last_share
+                                      : inner_share;
+      uint64_t &d = row[bx];
+      demand_squared -= d * d;
+      d = add ? d + share : d - share;
+      demand_squared += d * d;
+    }
+  }
+}
+
+template class rudy_cost<hpwl_cost>;
+template class rudy_cost<mcl_cost>;
+template class rudy_cost<star_cost>;
+template class rudy_cost<rsmt_cost>;
+
+// One annealing step at a fixed temperature. The moves of the step are
+// accepted or rolled back together, with per_move every move on its own.
+// Better costs are always accepted, worse ones with the chance
+// temp / MAX_TEMP. An accepted cost below best_cost is saved as the best
+// placement if save is set
+template <class Cost>
+static void anneal_step(Data &data, Cost &cost_model, Xoshiro256pp &rng,
+                        uint64_t temp,
+                        uint32_t window_x, uint32_t window_y,
+                        uint32_t moves_per_step, bool per_move, bool save,
+                        uint64_t &current_cost, uint64_t &best_cost) {
+  move_ranges ranges(data, window_x, window_y);
+  uint64_t cost;
+
+  // Accepts or rolls back the moves of the open transaction
+  auto decide = [&](uint64_t cost) {
     // 4. Decide if accept
     // If the cost is lower, we always accept
     if (cost > current_cost) {
       DEBUG("Larger than current cost")
-      if (xo_next() % MAX_TEMP < temp) {
+      if (rng.bounded(temp_range) < temp) {
         DEBUG("Accept anyways")
         // Moves are accepted
+        data.commit();
         current_cost = cost;
       } else {
-        DEBUG("Didn't accept. Resetting...")
-        data.reset_state();
+        DEBUG("Didn't accept. Rolling back...")
+        data.rollback();
       }
     }
 
     // 5. Update best configuration if warm-up is done
-    else if (cost < best_cost && i >= warmup_steps) {
+    else if (cost < best_cost && save) {
       DEBUG("Updating best configuration")
+      data.commit();
       data.save_best();
       best_cost = cost;
       current_cost = cost;
       // Accept moves if cost is lower
     } else {
+      data.commit();
       current_cost = cost;
     }
+  };
 
-    // 6. Update temperature, windows and moves
+  if (per_move) {
+    // 1.-5. Every move is its own transaction and gets accepted or rolled
+    // back on its own
+    uint64_t successful_moves = 0;
+    while (successful_moves < moves_per_step) {
+      data.begin_transaction();
+      if (!try_random_move(data, rng, ranges)) {
+        data.commit();
+        continue;
+      }
+      successful_moves++;
+      cost = data.update_cost(cost_model);
+      decide(cost);
+    }
+    return;
+  }
+
+  // 1. Start transaction
+  data.begin_transaction();
+  DEBUG("Started transaction")
+
+  // 2. Perform moves
+  uint64_t successful_moves = 0;
+  [[maybe_unused]]
+  uint64_t move_failures = 0;
+  while (successful_moves < moves_per_step) {
+    successful_moves += try_random_move(data, rng, ranges) ? 1 : 0;
+    if (try_random_move(data, rng, ranges)) {
+      successful_moves++;
+    } else {
+      move_failures++;
+    }
+    DEBUG(successful_moves, " Successful moves")
+  }
+  DEBUG(move_failures, " move failures for ", successful_moves,
+        " successful moves")
+
+  // 3. Compute cost
+
+  DEBUG("Computing cost")
+  cost = data.update_cost(cost_model);
+  DEBUG("New cost: ", cost)
+
+  decide(cost);
+}
+
+// One tuning step, only costs below best_cost are accepted. Returns true if
+// the step found one
+template <class Cost>
+static bool tuning_step(Data &data, Cost &cost_model, Xoshiro256pp &rng,
+                        uint32_t window_x,
+                        uint32_t window_y, uint32_t moves_per_step,
+                        bool per_move, uint64_t &best_cost) {
+  move_ranges ranges(data, window_x, window_y);
+  bool found_improvement = false;
+  // In per move mode every move is a transaction of its own
+  uint64_t successful_moves = 0;
+  while (successful_moves < moves_per_step) {
+    // 1. Start transaction
+    DEBUG("Started transaction")
+    data.begin_transaction();
+
+    // 2. Perform moves
+    uint64_t moves = 0;
+    while (moves < (per_move ? 1 : moves_per_step)) {
+      moves += try_random_move(data, rng, ranges) ? 1 : 0;
+      DEBUG(moves, " Successful moves")
+    }
+    successful_moves += moves;
+
+    // 3. Compute cost
+    DEBUG("Computing cost")
+    uint64_t cost = data.update_cost(cost_model);
+    DEBUG("New cost: ", cost)
+
+    // 4. Decide if accept
+    // If the cost is lower, we always accept
+    if (cost < best_cost) {
+      // Moves are accepted
+      DEBUG("Found improvement")
+      data.commit();
+      best_cost = cost;
+      found_improvement = true;
+    } else {
+      DEBUG("Larger than current cost. Rolling back...")
+      data.rollback();
+    }
+  }
+  return found_improvement;
+}
+
+// Temperature, windows and moves per step of an annealing run. Each goes down
+// from its initial to its final value in equal amounts spread over the steps
+struct schedule {
+  schedule(uint64_t initial_temp, uint64_t final_temp,
+           uint32_t initial_window_x, uint32_t final_window_x,
+           uint32_t initial_window_y, uint32_t final_window_y, uint64_t steps,
+           uint32_t initial_moves_per_step, uint32_t final_moves_per_step)
+      : temp(initial_temp), window_x(initial_window_x),
+        window_y(initial_window_y), moves_per_step(initial_moves_per_step) {
+    temp_reduction_interval = (steps / (initial_temp - final_temp)) > 0
+                                  ? steps / (initial_temp - final_temp)
+                                  : 1;
+    temp_reduction_counter = temp_reduction_interval;
+    temp_reduction_amount = ((initial_temp - final_temp) / steps) > 0
+                                ? ((initial_temp - final_temp) / steps)
+                                : 1;
+
+    window_x_reduction_interval =
+        (steps / (initial_window_x - final_window_x)) > 0
+            ? (steps / (initial_window_x - final_window_x))
+            : 1;
+    window_x_reduction_counter = window_x_reduction_interval;
+    window_x_reduction_amount =
+        ((initial_window_x - final_window_x) / steps) > 0
+            ? ((initial_window_x - final_window_x) / steps)
+            : 1;
+
+    window_y_reduction_interval =
+        (steps / (initial_window_y - final_window_y)) > 0
+            ? (steps / (initial_window_y - final_window_y))
+            : 1;
+    window_y_reduction_counter = window_y_reduction_interval;
+    window_y_reduction_amount =
+        ((initial_window_y - final_window_y) / steps) > 0
+            ? ((initial_window_y - final_window_y) / steps)
+            : 1;
+
+    move_reduction_interval =
+        (steps / (initial_moves_per_step - final_moves_per_step)) > 0
+            ? (steps / (initial_moves_per_step - final_moves_per_step))
+            : 1;
+    move_reduction_counter = move_reduction_interval;
+    move_reduction_amount =
+        ((initial_moves_per_step - final_moves_per_step) / steps) > 0
+            ? ((initial_moves_per_step - final_moves_per_step) / steps)
+            : 1;
+  }
+
+  // Called after every step
+  void advance() {
     temp_reduction_counter--;
     window_x_reduction_counter--;
     window_y_reduction_counter--;
@@ -323,6 +1105,73 @@ uint64_t anneal(Data &data, std::function<uint64_t(Data &)> cost_fn,
       move_reduction_counter = move_reduction_interval;
       DEBUG("Reducing moves per step to ", moves_per_step)
     }
+  }
+
+  uint64_t temp;
+  uint32_t window_x;
+  uint32_t window_y;
+  uint32_t moves_per_step;
+
+  uint64_t temp_reduction_interval;
+  uint64_t temp_reduction_counter;
+  uint64_t temp_reduction_amount;
+  uint64_t window_x_reduction_interval;
+  uint64_t window_x_reduction_counter;
+  uint64_t window_x_reduction_amount;
+  uint64_t window_y_reduction_interval;
+  uint64_t window_y_reduction_counter;
+  uint64_t window_y_reduction_amount;
+  uint64_t move_reduction_interval;
+  uint64_t move_reduction_counter;
+  uint64_t move_reduction_amount;
+};
+
+template <class Cost>
+uint64_t anneal(Data &data, Cost &cost_model, Xoshiro256pp &rng,
+                uint64_t initial_temp, uint64_t final_temp,
+                uint32_t initial_window_x, uint32_t final_window_x,
+                uint32_t initial_window_y, uint32_t final_window_y,
+                uint64_t steps, uint64_t warmup_steps, uint64_t tuning_steps,
+                uint32_t initial_moves_per_step, uint32_t final_moves_per_step,
+                bool per_move, bool logging_enabled, struct log logger) {
+  uint64_t current_cost = data.get_cost();
+  uint64_t best_cost = current_cost;
+  data.save_best();
+  schedule sched(initial_temp, final_temp, initial_window_x, final_window_x,
+                 initial_window_y, final_window_y, steps,
+                 initial_moves_per_step, final_moves_per_step);
+
+  uint64_t logging_counter = logger.interval > 0 ? logger.interval : 1;
+
+  DEBUG("Finished initialization. Starting main loop")
+  DEBUG("Initial temperature: ", sched.temp)
+  DEBUG("Final temperature: ", final_temp)
+  DEBUG("Temperature reduction interval: ", sched.temp_reduction_interval)
+  DEBUG("Temperature reduction amount: ", sched.temp_reduction_amount)
+
+  DEBUG("Initial window x: ", sched.window_x)
+  DEBUG("Final window x: ", final_window_x)
+  DEBUG("window x reduction interval: ", sched.window_x_reduction_interval)
+  DEBUG("window x reduction amount: ", sched.window_x_reduction_amount)
+
+  DEBUG("Initial window y: ", sched.window_y)
+  DEBUG("Final window y: ", final_window_y)
+  DEBUG("window y reduction interval: ", sched.window_y_reduction_interval)
+  DEBUG("window y reduction amount: ", sched.window_y_reduction_amount)
+
+  DEBUG("Initial moves per step: ", initial_moves_per_step)
+  DEBUG("Final moves per step: ", final_moves_per_step)
+  DEBUG("Move reduction interval: ", sched.move_reduction_interval)
+  DEBUG("Move reduction amount: ", sched.move_reduction_amount)
+
+  for (uint64_t i = 0; i < steps; i++) {
+
+    anneal_step(data, cost_model, rng, sched.temp, sched.window_x,
+                sched.window_y, sched.moves_per_step, per_move,
+                i >= warmup_steps, current_cost, best_cost);
+
+    // 6. Update temperature, windows and moves
+    sched.advance();
 
     // 7. Log
     logging_counter--;
@@ -341,32 +1190,9 @@ uint64_t anneal(Data &data, std::function<uint64_t(Data &)> cost_fn,
   // Tuning steps
   for (uint64_t i = steps; i < steps + tuning_steps; i++) {
 
-    // 1. Save state
-    DEBUG("Saved state ")
-    data.save_state();
-
-    // 2. Perform moves
-    uint64_t successful_moves = 0;
-    while (successful_moves < moves_per_step) {
-      successful_moves += try_random_move(data, window_x, window_y) ? 1 : 0;
-      DEBUG(successful_moves, " Successful moves")
-    }
-
-    // 3. Compute cost
-    DEBUG("Computing cost")
-    cost = cost_fn(data);
-    DEBUG("New cost: ", cost)
-
-    // 4. Decide if accept
-    // If the cost is lower, we always accept
-    if (cost < best_cost) {
-      // Moves are accepted
-      DEBUG("Found improvement")
-      best_cost = cost;
+    if (tuning_step(data, cost_model, rng, sched.window_x, sched.window_y,
+                    sched.moves_per_step, per_move, best_cost)) {
       tuning_found_improvement = true;
-    } else {
-      DEBUG("Larger than current cost. Resetting...")
-      data.reset_state();
     }
 
     // 5. Log
@@ -390,3 +1216,658 @@ uint64_t anneal(Data &data, std::function<uint64_t(Data &)> cost_fn,
   }
   return best_cost;
 }
+
+// A copy of data that anneals on a thread of its own, with its own cost and
+// random stream
+template <class Cost> struct annealing_copy {
+  Data data;
+  Cost cost;
+  uint64_t current_cost;
+  uint64_t best_cost;
+  Xoshiro256pp rng;
+};
+
+// The copies share the netlist of data. A deque never moves its elements, so
+// the cost every copy was set up with stays where it is. The streams are
+// jumped ahead from rng, which itself is left as it is
+template <class Cost>
+static std::deque<annealing_copy<Cost>>
+make_copies(Data &data, Cost &cost_model, const Xoshiro256pp &rng,
+            uint32_t count) {
+  std::deque<annealing_copy<Cost>> copies;
+  Xoshiro256pp stream = rng;
+  for (uint32_t k = 0; k < count; k++) {
+    stream.jump();
+    copies.push_back({data, cost_model, 0, 0, stream});
+    annealing_copy<Cost> &c = copies.back();
+    c.current_cost = c.data.init_cost(c.cost);
+    c.best_cost = c.current_cost;
+    c.data.save_best();
+  }
+  return copies;
+}
+
+// Calls run(k) for every k below count, each on a thread of its own, and
+// waits for all of them
+template <class F> static void run_round(uint32_t count, F run) {
+  std::vector<std::thread> workers;
+  for (uint32_t k = 1; k < count; k++) {
+    workers.emplace_back(run, k);
+  }
+  run(0);
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+}
+
+// The copy with the lowest best cost, the first of them on a tie
+template <class Cost>
+static annealing_copy<Cost> &
+best_copy(std::deque<annealing_copy<Cost>> &copies) {
+  annealing_copy<Cost> *best = &copies[0];
+  for (annealing_copy<Cost> &c : copies) {
+    if (c.best_cost < best->best_cost) {
+      best = &c;
+    }
+  }
+  return *best;
+}
+
+// Counts the logging interval down by a round of steps that ended with step
+// last. Once it is over, the cost and placement of shown are logged and true
+// is returned, so the caller can add lines of its own
+template <class Cost>
+static bool log_round(struct log &logger, uint64_t &logging_counter,
+                      uint64_t round, uint64_t last, const char *name,
+                      annealing_copy<Cost> &shown, uint64_t best_cost) {
+  if (logging_counter > round) {
+    logging_counter -= round;
+    return false;
+  }
+  LOG_INFO("Iteration ", last)
+  LOG_INFO(name, shown.current_cost)
+  LOG_INFO("Best ever cost ", best_cost)
+  logger.step = last;
+  save_pgm(shown.data, logger);
+  logging_counter = logger.interval > 0 ? logger.interval : 1;
+  return true;
+}
+
+// Runs the tuning steps after the annealing and saves data if they improved
+// best_cost. Returns the best cost
+template <class Cost>
+static uint64_t tune(Data &data, Cost &cost_model, Xoshiro256pp &rng,
+                     uint32_t window_x, uint32_t window_y,
+                     uint32_t moves_per_step, bool per_move,
+                     uint64_t tuning_steps, uint64_t best_cost) {
+  bool tuning_found_improvement = false;
+  for (uint64_t i = 0; i < tuning_steps; i++) {
+    if (tuning_step(data, cost_model, rng, window_x, window_y, moves_per_step,
+                    per_move, best_cost)) {
+      tuning_found_improvement = true;
+    }
+  }
+  if (tuning_found_improvement) {
+    LOG_INFO("Tuning found an improvement")
+    data.save_best();
+  }
+  return best_cost;
+}
+
+// Continues data from the best placement of all copies and tunes it
+template <class Cost>
+static uint64_t finish_from_best(Data &data, Cost &cost_model,
+                                 Xoshiro256pp &rng,
+                                 std::deque<annealing_copy<Cost>> &copies,
+                                 uint32_t window_x, uint32_t window_y,
+                                 uint32_t moves_per_step, bool per_move,
+                                 uint64_t tuning_steps) {
+  data.set_placement(best_copy(copies).data.get_best_blocks());
+  uint64_t best_cost = data.update_cost(cost_model);
+  data.save_best();
+  return tune(data, cost_model, rng, window_x, window_y, moves_per_step,
+              per_move, tuning_steps, best_cost);
+}
+
+template <class Cost>
+uint64_t anneal_tempering(Data &data, Cost &cost_model, Xoshiro256pp &rng,
+                          uint32_t replicas,
+                          uint64_t exchange_interval, uint64_t initial_temp,
+                          uint64_t final_temp, uint32_t initial_window_x,
+                          uint32_t final_window_x, uint32_t initial_window_y,
+                          uint32_t final_window_y, uint64_t steps,
+                          uint64_t warmup_steps, uint64_t tuning_steps,
+                          uint32_t initial_moves_per_step,
+                          uint32_t final_moves_per_step, bool per_move,
+                          bool logging_enabled, struct log logger) {
+  replicas = std::max<uint32_t>(replicas, 1);
+  exchange_interval = std::max<uint64_t>(exchange_interval, 1);
+
+  // rng decides the swaps
+  std::deque<annealing_copy<Cost>> r =
+      make_copies(data, cost_model, rng, replicas);
+
+  // Level 0 is the hottest. Temperatures are spaced geometrically, windows
+  // and moves per step linearly
+  std::vector<uint64_t> temps(replicas);
+  std::vector<uint32_t> windows_x(replicas);
+  std::vector<uint32_t> windows_y(replicas);
+  std::vector<uint32_t> moves(replicas);
+  for (uint32_t k = 0; k < replicas; k++) {
+    double t = replicas > 1 ? double(k) / (replicas - 1) : 0;
+    temps[k] = final_temp > 0 ? static_cast<uint64_t>(
+                                    initial_temp *
+                                    std::pow(double(final_temp) / initial_temp,
+                                             t))
+                              : static_cast<uint64_t>(initial_temp * (1 - t));
+    windows_x[k] = static_cast<uint32_t>(std::lround(
+        initial_window_x + (double(final_window_x) - initial_window_x) * t));
+    windows_y[k] = static_cast<uint32_t>(std::lround(
+        initial_window_y + (double(final_window_y) - initial_window_y) * t));
+    moves[k] = static_cast<uint32_t>(
+        std::lround(initial_moves_per_step +
+                    (double(final_moves_per_step) - initial_moves_per_step) *
+                        t));
+  }
+  // Replica at every level. Swapping the levels of two replicas is the same
+  // as swapping their placements, without copying them
+  std::vector<uint32_t> at(replicas);
+  for (uint32_t k = 0; k < replicas; k++) {
+    at[k] = k;
+  }
+
+  uint64_t logging_counter = logger.interval > 0 ? logger.interval : 1;
+  uint64_t swaps = 0;
+  uint64_t swap_attempts = 0;
+  for (uint64_t i = 0; i < steps; i += exchange_interval) {
+    uint64_t round = std::min(exchange_interval, steps - i);
+    run_round(replicas, [&](uint32_t k) {
+      annealing_copy<Cost> &rep = r[at[k]];
+      for (uint64_t j = i; j < i + round; j++) {
+        anneal_step(rep.data, rep.cost, rep.rng, temps[k], windows_x[k],
+                    windows_y[k], moves[k], per_move, j >= warmup_steps,
+                    rep.current_cost, rep.best_cost);
+      }
+    });
+
+    // Neighboring levels offer to swap, alternating between the even and the
+    // odd pairs. The colder level always takes a better placement and a worse
+    // one with the chance of its own temperature
+    for (uint32_t k = (i / exchange_interval) % 2; k + 1 < replicas; k += 2) {
+      swap_attempts++;
+      if (r[at[k]].current_cost < r[at[k + 1]].current_cost ||
+          rng.bounded(temp_range) < temps[k + 1]) {
+        std::swap(at[k], at[k + 1]);
+        swaps++;
+      }
+    }
+
+    // 7. Log
+    if (log_round(logger, logging_counter, round, i + round - 1,
+                  "Coldest replica cost ", r[at[replicas - 1]],
+                  best_copy(r).best_cost)) {
+      LOG_INFO("Accepted ", swaps, " of ", swap_attempts, " swaps")
+    }
+  }
+
+  // Continue from the best placement of all replicas
+  return finish_from_best(data, cost_model, rng, r, final_window_x,
+                          final_window_y, final_moves_per_step, per_move,
+                          tuning_steps);
+}
+
+template <class Cost>
+uint64_t anneal_islands(Data &data, Cost &cost_model, Xoshiro256pp &rng,
+                        uint32_t islands, uint64_t migration_interval,
+                        uint64_t initial_temp, uint64_t final_temp,
+                        uint32_t initial_window_x, uint32_t final_window_x,
+                        uint32_t initial_window_y, uint32_t final_window_y,
+                        uint64_t steps, uint64_t warmup_steps,
+                        uint64_t tuning_steps, uint32_t initial_moves_per_step,
+                        uint32_t final_moves_per_step, bool per_move,
+                        bool logging_enabled, struct log logger) {
+  islands = std::max<uint32_t>(islands, 1);
+  migration_interval = std::max<uint64_t>(migration_interval, 1);
+
+  // Like the tempering replicas, but every island follows the whole schedule
+  std::deque<annealing_copy<Cost>> r =
+      make_copies(data, cost_model, rng, islands);
+  std::vector<schedule> scheds(
+      islands, schedule(initial_temp, final_temp, initial_window_x,
+                        final_window_x, initial_window_y, final_window_y,
+                        steps, initial_moves_per_step, final_moves_per_step));
+
+  uint64_t logging_counter = logger.interval > 0 ? logger.interval : 1;
+  uint64_t migrations = 0;
+  for (uint64_t i = 0; i < steps; i += migration_interval) {
+    uint64_t round = std::min(migration_interval, steps - i);
+    run_round(islands, [&](uint32_t k) {
+      annealing_copy<Cost> &is = r[k];
+      schedule &sched = scheds[k];
+      for (uint64_t j = i; j < i + round; j++) {
+        anneal_step(is.data, is.cost, is.rng, sched.temp, sched.window_x,
+                    sched.window_y, sched.moves_per_step, per_move,
+                    j >= warmup_steps, is.current_cost, is.best_cost);
+        sched.advance();
+      }
+    });
+
+    // The worse half of the islands continues from the best placement found
+    // so far. Only the blocks are copied, every island keeps its own stream
+    // and the schedules are the same anyway
+    std::vector<uint32_t> order(islands);
+    for (uint32_t k = 0; k < islands; k++) {
+      order[k] = k;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return std::tie(r[a].best_cost, a) < std::tie(r[b].best_cost, b);
+    });
+    annealing_copy<Cost> &best = r[order[0]];
+    if (i + round < steps && islands > 1) {
+      std::vector<block> placement = best.data.get_best_blocks();
+      for (uint32_t k = islands - islands / 2; k < islands; k++) {
+        annealing_copy<Cost> &is = r[order[k]];
+        if (is.best_cost == best.best_cost) {
+          continue;
+        }
+        is.data.set_placement(placement);
+        is.current_cost = is.data.update_cost(is.cost);
+        is.best_cost = is.current_cost;
+        is.data.save_best();
+        migrations++;
+      }
+    }
+
+    // 7. Log
+    if (log_round(logger, logging_counter, round, i + round - 1,
+                  "Best island cost ", best, best.best_cost)) {
+      LOG_INFO("Migrated ", migrations, " placements")
+    }
+  }
+
+  // Continue from the best placement of all islands
+  return finish_from_best(data, cost_model, rng, r, final_window_x,
+                          final_window_y, final_moves_per_step, per_move,
+                          tuning_steps);
+}
+
+template <class Cost>
+uint64_t anneal_speculative(Data &data, Cost &cost_model, Xoshiro256pp &rng,
+                            uint32_t threads, uint32_t batch_size,
+                            uint64_t initial_temp, uint64_t final_temp,
+                            uint32_t initial_window_x, uint32_t final_window_x,
+                            uint32_t initial_window_y, uint32_t final_window_y,
+                            uint64_t steps, uint64_t warmup_steps,
+                            uint64_t tuning_steps,
+                            uint32_t initial_moves_per_step,
+                            uint32_t final_moves_per_step,
+                            bool logging_enabled, struct log logger) {
+  struct evaluator {
+    Data data;
+    Cost cost;
+  };
+  // Boxes around the old and the new geometry of a moved block, including
+  // their right and bottom edge
+  struct move_area {
+    uint32_t min_x;
+    uint32_t min_y;
+    uint32_t max_x;
+    uint32_t max_y;
+  };
+  struct evaluation {
+    bool legal;
+    int64_t delta;
+    move_area areas[2];
+  };
+
+  threads = std::max<uint32_t>(threads, 1);
+  batch_size = std::max<uint32_t>(batch_size, 1);
+  // Otherwise the batches never grow large enough to be shared
+  if (batch_size < SPECULATIVE_MIN_SHARE * threads) {
+    batch_size = SPECULATIVE_MIN_SHARE * threads;
+    LOG_INFO("Raising the batch size to ", batch_size, " for ", threads,
+             " threads")
+  }
+
+  uint64_t current_cost = data.get_cost();
+  uint64_t best_cost = current_cost;
+  data.save_best();
+  schedule sched(initial_temp, final_temp, initial_window_x, final_window_x,
+                 initial_window_y, final_window_y, steps,
+                 initial_moves_per_step, final_moves_per_step);
+
+  // data itself is evaluated by the main thread, every other thread gets a
+  // copy that shares the netlist
+  std::deque<evaluator> copies;
+  for (uint32_t t = 1; t < threads; t++) {
+    copies.push_back({data, cost_model});
+    copies.back().data.init_cost(copies.back().cost);
+  }
+
+  std::vector<move_proposal> proposals;
+  std::vector<evaluation> results(batch_size);
+  // Moves accepted since the copies last evaluated a batch. They make them
+  // before evaluating the next one. Once there are more of them than blocks,
+  // the copies take over the whole placement instead
+  std::vector<move_proposal> pending;
+  bool resync = false;
+  std::vector<block> placement;
+  bool done = false;
+
+  // The areas cover where the move would put the blocks even if it is not
+  // legal, an earlier move could free that space
+  auto set_areas = [&](Data &d, size_t j) {
+    const move_proposal &m = proposals[j];
+    evaluation &e = results[j];
+    size_t moved[2] = {m.block, m.other};
+    for (size_t k = 0; k < (m.type == SWAP ? 2 : 1); k++) {
+      block &b = d.get_block_by_index(moved[k]);
+      uint32_t x = b.x;
+      uint32_t y = b.y;
+      uint32_t len_x = b.len_x;
+      uint32_t len_y = b.len_y;
+      if (m.type == SHIFT && (m.x >= 0 || uint32_t(-m.x) <= b.x) &&
+          (m.y >= 0 || uint32_t(-m.y) <= b.y)) {
+        x += m.x;
+        y += m.y;
+      } else if (m.type == SWAP) {
+        block &other = d.get_block_by_index(moved[1 - k]);
+        x = other.x;
+        y = other.y;
+      } else if (m.type == ROT_CW || m.type == ROT_CC) {
+        std::swap(len_x, len_y);
+      }
+      e.areas[k] = {std::min(b.x, x), std::min(b.y, y),
+                    std::max(b.x + b.len_x, x + len_x),
+                    std::max(b.y + b.len_y, y + len_y)};
+    }
+    if (m.type != SWAP) {
+      e.areas[1] = e.areas[0];
+    }
+  };
+
+  // Makes a proposal in a transaction and rolls it back again
+  auto evaluate = [&](Data &d, Cost &cost, size_t j) {
+    evaluation &e = results[j];
+    set_areas(d, j);
+    uint64_t base = d.get_cost();
+    d.begin_transaction();
+    e.legal = make_move(d, proposals[j]);
+    if (e.legal) {
+      e.delta = static_cast<int64_t>(d.update_cost(cost) - base);
+    }
+    d.rollback();
+  };
+
+  // Both phases of a parallel batch end at the barrier: the evaluation by all
+  // threads and the decisions by the main thread
+  std::barrier sync(threads);
+  auto work = [&](uint32_t t) {
+    evaluator &me = copies[t - 1];
+    while (true) {
+      sync.arrive_and_wait();
+      if (done) {
+        return;
+      }
+      if (resync) {
+        me.data.set_placement(placement);
+        me.data.update_cost(me.cost);
+      } else if (!pending.empty()) {
+        for (const move_proposal &m : pending) {
+          make_move(me.data, m);
+        }
+        me.data.update_cost(me.cost);
+      }
+      for (size_t j = t; j < proposals.size(); j += threads) {
+        evaluate(me.data, me.cost, j);
+      }
+      sync.arrive_and_wait();
+    }
+  };
+  std::vector<std::thread> workers;
+  for (uint32_t t = 1; t < threads; t++) {
+    workers.emplace_back(work, t);
+  }
+
+  // Nets and areas of the moves accepted in the current batch. A later move
+  // of the batch that touches them was evaluated against a state that is gone
+  std::vector<uint64_t> net_claim(data.num_nets, 0);
+  std::vector<move_area> claimed_areas;
+  uint64_t batch = 0;
+  auto conflicts = [&](size_t j) {
+    const move_proposal &m = proposals[j];
+    size_t moved[2] = {m.block, m.other};
+    bool conflict = false;
+    for (size_t k = 0; k < (m.type == SWAP ? 2 : 1); k++) {
+      for (auto [net_index, slot] : data.get_block_nets(moved[k])) {
+        conflict = conflict || net_claim[net_index] == batch;
+      }
+    }
+    for (const move_area &a : claimed_areas) {
+      for (const move_area &b : results[j].areas) {
+        conflict = conflict || (a.min_x <= b.max_x && b.min_x <= a.max_x &&
+                                a.min_y <= b.max_y && b.min_y <= a.max_y);
+      }
+    }
+    return conflict;
+  };
+  auto claim = [&](size_t j) {
+    const move_proposal &m = proposals[j];
+    size_t moved[2] = {m.block, m.other};
+    for (size_t k = 0; k < (m.type == SWAP ? 2 : 1); k++) {
+      for (auto [net_index, slot] : data.get_block_nets(moved[k])) {
+        net_claim[net_index] = batch;
+      }
+    }
+    claimed_areas.push_back(results[j].areas[0]);
+    claimed_areas.push_back(results[j].areas[1]);
+  };
+
+  uint64_t logging_counter = logger.interval > 0 ? logger.interval : 1;
+  uint64_t step_moves = 0;
+  uint64_t total_conflicts = 0;
+  uint64_t parallel_moves = 0;
+  uint64_t i = 0;
+  // Called after every decided move with the cost after it
+  auto advance = [&](int64_t cost) {
+    // 6. Update temperature, windows and moves
+    step_moves++;
+    if (step_moves < sched.moves_per_step) {
+      return;
+    }
+    step_moves = 0;
+    sched.advance();
+    i++;
+
+    // 7. Log
+    logging_counter--;
+    if (logging_counter == 0) {
+      LOG_INFO("Iteration ", i - 1)
+      LOG_INFO("Current cost ", cost)
+      LOG_INFO("Best ever cost ", best_cost)
+      LOG_INFO("Evaluated ", total_conflicts, " conflicting moves again")
+      logger.step = i - 1;
+      save_pgm(data, logger);
+      logging_counter = logger.interval;
+    }
+  };
+
+  // While many moves are accepted, much of a large batch would conflict. The
+  // batch doubles while few of its moves conflict and halves when many do
+  size_t size = 1;
+  std::vector<move_proposal> accepted;
+  while (i < steps) {
+    move_ranges ranges(data, sched.window_x, sched.window_y);
+    proposals.resize(size);
+    for (move_proposal &m : proposals) {
+      m = draw_move(rng, ranges);
+    }
+    batch++;
+    claimed_areas.clear();
+    uint64_t decided = 0;
+    uint64_t conflicting = 0;
+
+    if (threads == 1 || size < SPECULATIVE_MIN_SHARE * threads) {
+      // Batches too small to share are made one move after the other, like
+      // anneal() does with per_move. The conflicts are only counted, so the
+      // batches grow the same way with any number of threads
+      for (size_t j = 0; j < size && i < steps; j++) {
+        set_areas(data, j);
+        conflicting += conflicts(j) ? 1 : 0;
+        data.begin_transaction();
+        if (!make_move(data, proposals[j])) {
+          data.commit();
+          continue;
+        }
+        decided++;
+        uint64_t cost = data.update_cost(cost_model);
+        // 4. Decide if accept
+        if (cost <= current_cost || rng.bounded(temp_range) < sched.temp) {
+          data.commit();
+          current_cost = cost;
+          // 5. Update best configuration if warm-up is done
+          if (current_cost < best_cost && i >= warmup_steps) {
+            data.save_best();
+            best_cost = current_cost;
+          }
+          claim(j);
+          if (threads > 1 && !resync) {
+            pending.push_back(proposals[j]);
+            if (pending.size() > data.num_blocks) {
+              pending.clear();
+              resync = true;
+            }
+          }
+        } else {
+          data.rollback();
+        }
+        advance(current_cost);
+      }
+    } else {
+      parallel_moves += size;
+      if (resync) {
+        placement.resize(data.num_blocks);
+        for (size_t k = 0; k < data.num_blocks; k++) {
+          placement[k] = data.get_block_by_index(k);
+        }
+      }
+      sync.arrive_and_wait();
+      for (size_t j = 0; j < size; j += threads) {
+        evaluate(data, cost_model, j);
+      }
+      sync.arrive_and_wait();
+      pending.clear();
+      resync = false;
+
+      // Decide in the order the moves were drawn. A conflicting move is
+      // evaluated again after data caught up with the accepted moves. The
+      // deltas of all other moves still hold and add up, so the moves are
+      // decided as if they were made one after the other
+      accepted.clear();
+      size_t made = 0;
+      int64_t cost = static_cast<int64_t>(current_cost);
+      // Accepted moves up to the lowest cost of the batch, if it is a new best
+      int64_t lowest = static_cast<int64_t>(best_cost);
+      size_t best_prefix = 0;
+      auto catch_up = [&]() {
+        for (; made < accepted.size(); made++) {
+          make_move(data, accepted[made]);
+          // 5. Update best configuration if warm-up is done
+          // With rudy_cost the deltas are only estimates, so check again
+          if (made + 1 == best_prefix &&
+              data.update_cost(cost_model) < best_cost) {
+            best_cost = data.get_cost();
+            data.save_best();
+          }
+        }
+        current_cost = data.update_cost(cost_model);
+        cost = static_cast<int64_t>(current_cost);
+      };
+      for (size_t j = 0; j < size && i < steps; j++) {
+        const evaluation &e = results[j];
+        if (conflicts(j)) {
+          conflicting++;
+          catch_up();
+          evaluate(data, cost_model, j);
+        }
+        if (!e.legal) {
+          continue;
+        }
+        decided++;
+        // 4. Decide if accept
+        if (e.delta <= 0 || rng.bounded(temp_range) < sched.temp) {
+          accepted.push_back(proposals[j]);
+          cost += e.delta;
+          if (cost < lowest && i >= warmup_steps) {
+            lowest = cost;
+            best_prefix = accepted.size();
+          }
+          claim(j);
+        }
+        advance(cost);
+      }
+      catch_up();
+      pending.insert(pending.end(), accepted.begin(), accepted.end());
+    }
+
+    total_conflicts += conflicting;
+    if (conflicting * 16 <= decided) {
+      size = std::min<size_t>(2 * size, batch_size);
+    } else if (conflicting * 4 > decided) {
+      size = std::max<size_t>(size / 2, 1);
+    }
+  }
+  done = true;
+  sync.arrive_and_wait();
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  LOG_INFO("Evaluated ", parallel_moves, " moves in parallel, ",
+           total_conflicts, " of all moves conflicted")
+
+  return tune(data, cost_model, rng, sched.window_x, sched.window_y,
+              sched.moves_per_step, true, tuning_steps, best_cost);
+}
+
+#define INSTANTIATE_ANNEAL(Cost)                                               \
+  template uint64_t anneal<Cost>(                                              \
+      Data & data, Cost & cost_model, Xoshiro256pp & rng,                      \
+      uint64_t initial_temp, uint64_t final_temp, uint32_t initial_window_x,   \
+      uint32_t final_window_x, uint32_t initial_window_y,                      \
+      uint32_t final_window_y, uint64_t steps, uint64_t warmup_steps,          \
+      uint64_t tuning_steps, uint32_t initial_moves_per_step,                  \
+      uint32_t final_moves_per_step, bool per_move, bool logging_enabled,      \
+      struct log logger);                                                      \
+  template uint64_t anneal_tempering<Cost>(                                    \
+      Data & data, Cost & cost_model, Xoshiro256pp & rng, uint32_t replicas,   \
+      uint64_t exchange_interval, uint64_t initial_temp, uint64_t final_temp,  \
+      uint32_t initial_window_x, uint32_t final_window_x,                      \
+      uint32_t initial_window_y, uint32_t final_window_y, uint64_t steps,      \
+      uint64_t warmup_steps, uint64_t tuning_steps,                            \
+      uint32_t initial_moves_per_step, uint32_t final_moves_per_step,          \
+      bool per_move, bool logging_enabled, struct log logger);                 \
+  template uint64_t anneal_islands<Cost>(                                      \
+      Data & data, Cost & cost_model, Xoshiro256pp & rng, uint32_t islands,    \
+      uint64_t migration_interval, uint64_t initial_temp, uint64_t final_temp, \
+      uint32_t initial_window_x, uint32_t final_window_x,                      \
+      uint32_t initial_window_y, uint32_t final_window_y, uint64_t steps,      \
+      uint64_t warmup_steps, uint64_t tuning_steps,                            \
+      uint32_t initial_moves_per_step, uint32_t final_moves_per_step,          \
+      bool per_move, bool logging_enabled, struct log logger);                 \
+  template uint64_t anneal_speculative<Cost>(                                  \
+      Data & data, Cost & cost_model, Xoshiro256pp & rng, uint32_t threads,    \
+      uint32_t batch_size, uint64_t initial_temp, uint64_t final_temp,         \
+      uint32_t initial_window_x, uint32_t final_window_x,                      \
+      uint32_t initial_window_y, uint32_t final_window_y, uint64_t steps,      \
+      uint64_t warmup_steps, uint64_t tuning_steps,                            \
+      uint32_t initial_moves_per_step, uint32_t final_moves_per_step,          \
+      bool logging_enabled, struct log logger);
+
+INSTANTIATE_ANNEAL(hpwl_cost)
+INSTANTIATE_ANNEAL(mcl_cost)
+INSTANTIATE_ANNEAL(star_cost)
+INSTANTIATE_ANNEAL(rsmt_cost)
+INSTANTIATE_ANNEAL(rudy_cost<hpwl_cost>)
+INSTANTIATE_ANNEAL(rudy_cost<mcl_cost>)
+INSTANTIATE_ANNEAL(rudy_cost<star_cost>)
+INSTANTIATE_ANNEAL(rudy_cost<rsmt_cost>)
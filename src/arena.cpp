@@ -0,0 +1,85 @@
+#include "../include/arena.h"
+#include "../include/panic.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/mman.h>
+
+Arena::Arena() {
+  current = nullptr;
+  end = nullptr;
+  next_chunk_size = ARENA_MIN_CHUNK;
+  used_bytes = 0;
+  reserved_bytes = 0;
+}
+
+Arena::~Arena() {
+  for (chunk &c : chunks) {
+    munmap(c.start, c.size);
+  }
+}
+
+size_t Arena::used() { return used_bytes; }
+
+size_t Arena::reserved() { return reserved_bytes; }
+
+void Arena::new_chunk(size_t min_size) {
+  size_t size = std::max(next_chunk_size, min_size);
+  bool huge = size >= ARENA_HUGE_PAGE;
+  if (huge) {
+    // Round up to whole huge pages
+    size = (size + ARENA_HUGE_PAGE - 1) / ARENA_HUGE_PAGE * ARENA_HUGE_PAGE;
+  }
+  // Map one extra huge page, so the chunk can start on a huge page boundary
+  size_t map_size = huge ? size + ARENA_HUGE_PAGE : size;
+  void *p = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    panic("Arena failed to map " + std::to_string(map_size) + " bytes");
+  }
+  char *start = static_cast<char *>(p);
+  if (huge) {
+    uintptr_t offset = reinterpret_cast<uintptr_t>(start) % ARENA_HUGE_PAGE;
+    size_t front = offset > 0 ? ARENA_HUGE_PAGE - offset : 0;
+    // Give the unaligned ends back
+    if (front > 0) {
+      munmap(start, front);
+    }
+    if (ARENA_HUGE_PAGE - front > 0) {
+      munmap(start + front + size, ARENA_HUGE_PAGE - front);
+    }
+    start += front;
+#ifdef MADV_HUGEPAGE
+    // Only a hint, the arena works the same without huge pages
+    madvise(start, size, MADV_HUGEPAGE);
+#endif
+  }
+  chunks.push_back({start, size});
+  current = start;
+  end = start + size;
+  reserved_bytes += size;
+  next_chunk_size = std::min<size_t>(2 * next_chunk_size, ARENA_MAX_CHUNK);
+}
+
+void *Arena::do_allocate(size_t bytes, size_t alignment) {
+  uintptr_t p = reinterpret_cast<uintptr_t>(current);
+  uintptr_t aligned = (p + alignment - 1) & ~(uintptr_t{alignment} - 1);
+  if (current == nullptr || aligned + bytes > reinterpret_cast<uintptr_t>(end)) {
+    // mmap returns page aligned memory
+    new_chunk(bytes);
+    aligned = reinterpret_cast<uintptr_t>(current);
+  }
+  current = reinterpret_cast<char *>(aligned + bytes);
+  used_bytes += bytes;
+  return reinterpret_cast<void *>(aligned);
+}
+
+void Arena::do_deallocate(void *p, size_t bytes, size_t alignment) {
+  // Memory is only given back when the arena is destroyed
+}
+
+bool Arena::do_is_equal(const std::pmr::memory_resource &other) const
+    noexcept {
+  return this == &other;
+}
@@ -0,0 +1,3 @@
+#include "../include/cpu.h"
+
+const bool has_avx2 = __builtin_cpu_supports("avx2");
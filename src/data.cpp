@@ -1,37 +1,97 @@
 #include "../include/data.h"
+#include "../include/cpu.h"
 #include "../include/debug.h"
 #include "../include/panic.h"
 #include <algorithm>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <immintrin.h>
 #include <string>
 #include <tuple>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
-Data::Data(uint32_t chip_x, uint32_t chip_y) : chip_x(chip_x), chip_y(chip_y) {
+#define DEFAULT_BIN_SIZE 16
+
+// Bit i of the result is set if the candidate rectangle overlaps block i of
+// the 8 blocks starting at the given pointers. Same semantics as overlap()
+__attribute__((target("avx2"))) static uint32_t
+overlap_mask_avx2(const uint32_t *bx, const uint32_t *by,
+                  const uint32_t *bx_end, const uint32_t *by_end, uint32_t x,
+                  uint32_t y, uint32_t x_end, uint32_t y_end) {
+  __m256i b_x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bx));
+  __m256i b_y = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(by));
+  __m256i b_x_end =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(bx_end));
+  __m256i b_y_end =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i *>(by_end));
+  __m256i a_x = _mm256_set1_epi32(x);
+  __m256i a_y = _mm256_set1_epi32(y);
+  __m256i a_x_end = _mm256_set1_epi32(x_end);
+  __m256i a_y_end = _mm256_set1_epi32(y_end);
+  // There is no unsigned compare, but a <= b is the same as max(a, b) == b
+  __m256i hit = _mm256_cmpeq_epi32(_mm256_max_epu32(a_x, b_x_end), b_x_end);
+  hit = _mm256_and_si256(
+      hit, _mm256_cmpeq_epi32(_mm256_max_epu32(a_x_end, b_x), a_x_end));
+  hit = _mm256_and_si256(
+      hit, _mm256_cmpeq_epi32(_mm256_max_epu32(a_y, b_y_end), b_y_end));
+  hit = _mm256_and_si256(
+      hit, _mm256_cmpeq_epi32(_mm256_max_epu32(a_y_end, b_y), a_y_end));
+  return _mm256_movemask_ps(_mm256_castsi256_ps(hit));
+}
+
+Data::Data(uint32_t chip_x, uint32_t chip_y)
+    : chip_x(chip_x), chip_y(chip_y), shared(std::make_shared<netlist>()),
+      nets(shared->nets), block_id_to_index(shared->block_id_to_index),
+      net_id_to_index(shared->net_id_to_index), pin_ids(shared->pin_ids),
+      pin_begin(shared->pin_begin), pin_count(shared->pin_count),
+      pin_capacity(shared->pin_capacity), block_pins(shared->block_pins),
+      input_ids(shared->input_ids), output_ids(shared->output_ids) {
   // All of this is not needed
   num_blocks = 0;
   num_nets = 0;
   blocks.clear();
   nets.clear();
-  reset_blocks.clear();
-  reset_nets.clear();
-  best_blocks.clear();
-  best_nets.clear();
+  best_pins_valid = false;
+  cost_model = nullptr;
+  net_total = 0;
+  total_cost = 0;
+  rollback_net_total = 0;
+  rollback_total_cost = 0;
+  transaction_open = false;
+  build_bins(DEFAULT_BIN_SIZE);
 }
 
 void Data::add_net(net n) {
+  own_netlist();
+  if (!net_id_to_index.emplace(n.id, num_nets).second) {
+    panic("Net id " + std::to_string(n.id) + " was added twice");
+  }
   nets.push_back(n);
+  pin_begin.push_back(pin_ids.size());
+  pin_count.push_back(0);
+  pin_capacity.push_back(0);
+  net_costs.push_back(0);
+  net_weight.push_back(NET_WEIGHT_FULL);
+  net_dirty.push_back(false);
   num_nets++;
 }
 
-void Data::add_input(uint64_t id) { input_ids.push_back(id); }
+void Data::add_input(uint64_t id) {
+  own_netlist();
+  input_ids.push_back(id);
+}
 
-void Data::add_output(uint64_t id) { output_ids.push_back(id); }
+void Data::add_output(uint64_t id) {
+  own_netlist();
+  output_ids.push_back(id);
+}
 
 bool Data::create_pins() {
+  own_netlist();
   if (input_ids.size() + output_ids.size() == 0) {
     ERROR("No pins detected")
     return true;
@@ -56,8 +116,7 @@ bool Data::create_pins() {
     if (y > chip_y) {
       panic("Input pin was placed outside of chip");
     }
-    auto &n = get_net_by_id(id);
-    n.pins.emplace(n.pins.begin(), UINT64_MAX, 0, y);
+    insert_pin(&get_net_by_id(id) - nets.data(), 0, UINT64_MAX, 0, y);
     y += dist + 1;
   }
 
@@ -71,28 +130,122 @@ bool Data::create_pins() {
     if (y > chip_y) {
       panic("Output pin was placed outside of chip");
     }
-    auto &n = get_net_by_id(id);
-    n.pins.emplace(n.pins.begin(), UINT64_MAX, chip_x - 1, y);
+    insert_pin(&get_net_by_id(id) - nets.data(), 0, UINT64_MAX, chip_x - 1,
+               y);
     y += dist + 1;
   }
 
+  // Inserting at the front moved the other pins to new slots
+  build_pin_index();
   return true;
 }
 
 // Only call this method after all nets have been added. Assumes that b.nets
 // contains ids in this.nets
-void Data::add_block(block b) {
+void Data::add_block(const block &b) {
+  own_netlist();
   if (b.len_x == 0 || b.len_y == 0 || b.len_x >= chip_x || b.len_y >= chip_y) {
     panic("Block has invalid size of len_x " + std::to_string(b.len_x) +
           " and len_y " + std::to_string(b.len_y) + " with chip_x " +
           std::to_string(chip_x) + " chip_y " + std::to_string(chip_y));
   }
-  blocks.push_back(b);
+  if (!block_id_to_index.emplace(b.id, num_blocks).second) {
+    panic("Block id " + std::to_string(b.id) + " was added twice");
+  }
+  // The nets are kept in block_pins, so don't copy net_ids
+  blocks.push_back({b.id, b.x, b.y, b.len_x, b.len_y, {}, b.corner});
   num_blocks++;
+  insert_bins(num_blocks - 1);
   // Add to nets
+  block_pins.emplace_back(&shared->arena);
+  block_pins.back().reserve(b.net_ids.size());
+  pins_stale.push_back(false);
   for (uint64_t id : b.net_ids) {
-    net &n = get_net_by_id(id);
-    n.pins.emplace_back(b.id, b.x, b.y);
+    size_t i = &get_net_by_id(id) - nets.data();
+    block_pins.back().emplace_back(i, pin_count[i]);
+    insert_pin(i, pin_count[i], b.id, pin_pos_x(b), pin_pos_y(b));
+  }
+}
+
+void Data::own_netlist() {
+  if (shared.use_count() > 1) {
+    panic("The netlist is shared with a copy and can't be changed");
+  }
+  shared->degree_buckets_valid = false;
+}
+
+void Data::insert_pin(size_t net_index, size_t slot, uint64_t id, uint32_t x,
+                      uint32_t y) {
+  size_t begin = pin_begin[net_index];
+  size_t count = pin_count[net_index];
+  if (count == pin_capacity[net_index]) {
+    // Move the net to the end with twice the capacity. The old slots become
+    // a gap until compact_pins() is called
+    size_t capacity = count > 2 ? 2 * count : 4;
+    size_t new_begin = pin_ids.size();
+    pin_ids.resize(new_begin + capacity);
+    pin_x.resize(new_begin + capacity);
+    pin_y.resize(new_begin + capacity);
+    std::copy_n(pin_ids.begin() + begin, count, pin_ids.begin() + new_begin);
+    std::copy_n(pin_x.begin() + begin, count, pin_x.begin() + new_begin);
+    std::copy_n(pin_y.begin() + begin, count, pin_y.begin() + new_begin);
+    begin = new_begin;
+    pin_begin[net_index] = begin;
+    pin_capacity[net_index] = capacity;
+  }
+  // Make room at the slot
+  std::copy_backward(pin_ids.begin() + begin + slot,
+                     pin_ids.begin() + begin + count,
+                     pin_ids.begin() + begin + count + 1);
+  std::copy_backward(pin_x.begin() + begin + slot,
+                     pin_x.begin() + begin + count,
+                     pin_x.begin() + begin + count + 1);
+  std::copy_backward(pin_y.begin() + begin + slot,
+                     pin_y.begin() + begin + count,
+                     pin_y.begin() + begin + count + 1);
+  pin_ids[begin + slot] = id;
+  pin_x[begin + slot] = x;
+  pin_y[begin + slot] = y;
+  pin_count[net_index]++;
+}
+
+void Data::compact_pins() {
+  size_t total = 0;
+  for (size_t i = 0; i < num_nets; i++) {
+    total += pin_count[i];
+  }
+  std::vector<uint64_t> ids(total);
+  std::vector<uint32_t> x(total);
+  std::vector<uint32_t> y(total);
+  size_t begin = 0;
+  for (size_t i = 0; i < num_nets; i++) {
+    std::copy_n(pin_ids.begin() + pin_begin[i], pin_count[i],
+                ids.begin() + begin);
+    std::copy_n(pin_x.begin() + pin_begin[i], pin_count[i], x.begin() + begin);
+    std::copy_n(pin_y.begin() + pin_begin[i], pin_count[i], y.begin() + begin);
+    pin_begin[i] = begin;
+    pin_capacity[i] = pin_count[i];
+    begin += pin_count[i];
+  }
+  pin_ids = std::move(ids);
+  pin_x = std::move(x);
+  pin_y = std::move(y);
+}
+
+void Data::build_pin_index() {
+  for (auto &pins : block_pins) {
+    pins.clear();
+  }
+  block_pins.resize(num_blocks);
+  for (size_t i = 0; i < num_nets; i++) {
+    for (size_t slot = 0; slot < pin_count[i]; slot++) {
+      uint64_t id = pin_ids[pin_begin[i] + slot];
+      // Input and output pins don't belong to a block
+      if (id == UINT64_MAX) {
+        continue;
+      }
+      block_pins[block_id_to_index.at(id)].emplace_back(i, slot);
+    }
   }
 }
 
@@ -101,7 +254,9 @@ bool Data::overlap(block &a, block &b) {
           a.y <= b.y + b.len_y && a.y + a.len_y >= b.y);
 }
 
-bool Data::legal(block &a) {
+bool Data::legal(block &a) { return legal(a, a.id); }
+
+bool Data::legal(block &a, uint64_t other_id) {
   // Check if out of bounds with overflow protection
   // Because overflow is checked, it should not be needed to check if a.x and
   // a.y are already outside of the chip
@@ -110,46 +265,197 @@ bool Data::legal(block &a) {
       a.y + a.len_y >= chip_y || a.y + a.len_y <= a.y) {
     return false;
   }
-  for (block &b : blocks) {
-    if (a.id == b.id) {
-      continue;
-    }
-    if (overlap(a, b)) {
-      return false;
+  // No overflow possible, the block is inside the chip
+  uint32_t x_end = a.x + a.len_x;
+  uint32_t y_end = a.y + a.len_y;
+  size_t first_x = std::min<size_t>(a.x / bin_size, bins_x - 1);
+  size_t last_x = std::min<size_t>(x_end / bin_size, bins_x - 1);
+  size_t first_y = std::min<size_t>(a.y / bin_size, bins_y - 1);
+  size_t last_y = std::min<size_t>(y_end / bin_size, bins_y - 1);
+  for (size_t bin_y = first_y; bin_y <= last_y; bin_y++) {
+    for (size_t bin_x = first_x; bin_x <= last_x; bin_x++) {
+      bin &bin = bins[bin_y * bins_x + bin_x];
+      size_t size = bin.index.size();
+      size_t i = 0;
+      // Test 8 blocks at a time. Hits are rare, so checking the id of the
+      // hits afterwards is cheaper than loading the ids
+      if (has_avx2) {
+        for (; i + 8 <= size; i += 8) {
+          uint32_t mask = overlap_mask_avx2(
+              &bin.x[i], &bin.y[i], &bin.x_end[i], &bin.y_end[i], a.x, a.y,
+              x_end, y_end);
+          while (mask != 0) {
+            size_t hit = i + std::countr_zero(mask);
+            uint64_t id = blocks[bin.index[hit]].id;
+            if (id != a.id && id != other_id) {
+              return false;
+            }
+            mask &= mask - 1;
+          }
+        }
+      }
+      for (; i < size; i++) {
+        if (a.x <= bin.x_end[i] && x_end >= bin.x[i] && a.y <= bin.y_end[i] &&
+            y_end >= bin.y[i]) {
+          uint64_t id = blocks[bin.index[i]].id;
+          if (id != a.id && id != other_id) {
+            return false;
+          }
+        }
+      }
     }
   }
 
   return true;
 }
 
+void Data::build_bins(uint32_t size) {
+  bin_size = size > 0 ? size : 1;
+  // Block edges can lie on chip_x and chip_y
+  bins_x = chip_x / bin_size + 1;
+  bins_y = chip_y / bin_size + 1;
+  bins.clear();
+  bins.resize(bins_x * bins_y);
+  for (size_t i = 0; i < num_blocks; i++) {
+    insert_bins(i);
+  }
+}
+
+void Data::bin_range(uint32_t x, uint32_t y, uint32_t len_x, uint32_t len_y,
+                     size_t &first_x, size_t &last_x, size_t &first_y,
+                     size_t &last_y) {
+  // Blocks added by hand don't have to be inside the chip, so clamp to the
+  // grid and use 64 bit to avoid overflows
+  first_x = std::min<uint64_t>(x / bin_size, bins_x - 1);
+  last_x = std::min<uint64_t>((uint64_t{x} + len_x) / bin_size, bins_x - 1);
+  first_y = std::min<uint64_t>(y / bin_size, bins_y - 1);
+  last_y = std::min<uint64_t>((uint64_t{y} + len_y) / bin_size, bins_y - 1);
+}
+
+void Data::insert_bins(size_t index) {
+  block &b = blocks[index];
+  size_t first_x, last_x, first_y, last_y;
+  bin_range(b.x, b.y, b.len_x, b.len_y, first_x, last_x, first_y, last_y);
+  for (size_t bin_y = first_y; bin_y <= last_y; bin_y++) {
+    for (size_t bin_x = first_x; bin_x <= last_x; bin_x++) {
+      bin &bin = bins[bin_y * bins_x + bin_x];
+      bin.index.push_back(index);
+      bin.x.push_back(b.x);
+      bin.y.push_back(b.y);
+      bin.x_end.push_back(b.x + b.len_x);
+      bin.y_end.push_back(b.y + b.len_y);
+    }
+  }
+}
+
+void Data::remove_bins(size_t index, uint32_t x, uint32_t y, uint32_t len_x,
+                       uint32_t len_y) {
+  size_t first_x, last_x, first_y, last_y;
+  bin_range(x, y, len_x, len_y, first_x, last_x, first_y, last_y);
+  for (size_t bin_y = first_y; bin_y <= last_y; bin_y++) {
+    for (size_t bin_x = first_x; bin_x <= last_x; bin_x++) {
+      bin &bin = bins[bin_y * bins_x + bin_x];
+      size_t i = find_in_bin(bin, index);
+      // Order inside a bin doesn't matter
+      bin.index[i] = bin.index.back();
+      bin.x[i] = bin.x.back();
+      bin.y[i] = bin.y.back();
+      bin.x_end[i] = bin.x_end.back();
+      bin.y_end[i] = bin.y_end.back();
+      bin.index.pop_back();
+      bin.x.pop_back();
+      bin.y.pop_back();
+      bin.x_end.pop_back();
+      bin.y_end.pop_back();
+    }
+  }
+}
+
+void Data::update_bins(size_t index, uint32_t x, uint32_t y, uint32_t len_x,
+                       uint32_t len_y) {
+  block &b = blocks[index];
+  size_t first_x, last_x, first_y, last_y;
+  bin_range(x, y, len_x, len_y, first_x, last_x, first_y, last_y);
+  size_t new_first_x, new_last_x, new_first_y, new_last_y;
+  bin_range(b.x, b.y, b.len_x, b.len_y, new_first_x, new_last_x, new_first_y,
+            new_last_y);
+  if (first_x != new_first_x || last_x != new_last_x ||
+      first_y != new_first_y || last_y != new_last_y) {
+    remove_bins(index, x, y, len_x, len_y);
+    insert_bins(index);
+    return;
+  }
+  // Small shifts usually stay in the same bins, so only the copied geometry
+  // has to be updated
+  for (size_t bin_y = first_y; bin_y <= last_y; bin_y++) {
+    for (size_t bin_x = first_x; bin_x <= last_x; bin_x++) {
+      bin &bin = bins[bin_y * bins_x + bin_x];
+      size_t i = find_in_bin(bin, index);
+      bin.x[i] = b.x;
+      bin.y[i] = b.y;
+      bin.x_end[i] = b.x + b.len_x;
+      bin.y_end[i] = b.y + b.len_y;
+    }
+  }
+}
+
+size_t Data::find_in_bin(bin &bin, size_t index) {
+  auto it = std::find(bin.index.begin(), bin.index.end(), index);
+  if (it == bin.index.end()) {
+    panic("Block index " + std::to_string(index) + " missing in bin");
+  }
+  return it - bin.index.begin();
+}
+
 block &Data::get_block_by_index(size_t index) { return blocks[index]; }
 
 net &Data::get_net_by_index(size_t index) { return nets[index]; }
 
 block &Data::get_block_by_id(uint64_t id) {
-  for (block &b : blocks) {
-    if (b.id == id) {
-      return b;
-    }
+  auto it = block_id_to_index.find(id);
+  if (it == block_id_to_index.end()) {
+    panic("Tried to access block id " + std::to_string(id));
   }
-  // Hopefully this doesn't happen
-  panic("Tried to access block id " + std::to_string(id));
-  return blocks[0];
+  return blocks[it->second];
 }
 
 net &Data::get_net_by_id(uint64_t id) {
-  // Shortcut if the user was smart
-  if (id < num_nets && nets[id].id == id) {
-    return nets[id];
+  auto it = net_id_to_index.find(id);
+  if (it == net_id_to_index.end()) {
+    panic("Tried to access net id " + std::to_string(id));
   }
+  return nets[it->second];
+}
+
+pin_span Data::get_pins(size_t net_index) {
+  // The pins of moved blocks are only written when pins are read
+  update_pins();
+  return pins_of(net_index);
+}
+
+pin_span Data::get_pins(net &n) { return get_pins(&n - nets.data()); }
 
-  for (net &n : nets) {
-    if (n.id == id) {
-      return n;
+const std::vector<size_t> &Data::get_degree_bucket(size_t bucket) {
+  if (!shared->degree_buckets_valid.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> lock(shared->degree_buckets_mutex);
+    if (!shared->degree_buckets_valid.load(std::memory_order_relaxed)) {
+      for (std::vector<size_t> &nets : shared->degree_buckets) {
+        nets.clear();
+      }
+      for (size_t i = 0; i < num_nets; i++) {
+        size_t size = pin_count[i];
+        shared->degree_buckets[(size >= 2 && size <= 4) ? size - 2 : 3]
+            .push_back(i);
+      }
+      shared->degree_buckets_valid.store(true, std::memory_order_release);
     }
   }
-  panic("Tried to access net id " + std::to_string(id));
-  return nets[0];
+  return shared->degree_buckets[bucket];
+}
+
+std::span<const std::pair<size_t, size_t>>
+Data::get_block_nets(size_t index) {
+  return block_pins[index];
 }
 
 size_t Data::get_index_from_pos(uint32_t x, uint32_t y) {
@@ -164,6 +470,8 @@ size_t Data::get_index_from_pos(uint32_t x, uint32_t y) {
 }
 
 bool Data::find_initial_placement() {
+  // Sorting the blocks changes the block index of the netlist
+  own_netlist();
 
   DEBUG("Finding initial placement")
   // Use one of the placers to find an initial legal placement
@@ -171,8 +479,14 @@ bool Data::find_initial_placement() {
 
   // Sort blocks by height
   DEBUG("Number of blocks ", blocks.size())
+  // Pending pin writes use the old block indices
+  update_pins();
   std::sort(blocks.begin(), blocks.end(),
             [](block &a, block &b) { return a.len_y > b.len_y; });
+  for (size_t i = 0; i < num_blocks; i++) {
+    block_id_to_index[blocks[i].id] = i;
+  }
+  build_pin_index();
   for (block &b : blocks) {
     DEBUG("Placing block ", b.id)
     if (!placer.place(b)) {
@@ -181,27 +495,18 @@ bool Data::find_initial_placement() {
             " with len_x ", b.len_x, " and len_y ", b.len_y)
       return false;
     }
-    // Update pin positions.
-    // NOTE: Maybe it would be faster or more readable to do this after all
-    // blocks have been placed. But to do it here makes it easier to add
-    // flipping/rotations to the placer at a later point
-    for (uint32_t n_id : b.net_ids) {
-      net &n = get_net_by_id(n_id);
-      for (size_t i = 0; i < n.pins.size(); i++) {
-        auto [id, n_x, n_y] = n.pins[i];
-        if (id != b.id) {
-          continue;
-        }
-        // No over- or underflow check needed because pin must be inside or on
-        // the edge of the block and it has already been checked in the
-        // legal() function Pin coordinations added to new block position
-        n_x += b.x;
-        n_y += b.y;
-        n.pins[i] = std::make_tuple(id, n_x, n_y);
-      }
-    }
+    write_pins(&b - blocks.data(), current_cost());
   }
 
+  // Sorting changed the block indices. Bins of about four block sides hold
+  // enough blocks to fill the 8 wide overlap kernel, while a block still
+  // covers no more than four of them
+  uint64_t side_sum = 0;
+  for (block &b : blocks) {
+    side_sum += std::max(b.len_x, b.len_y);
+  }
+  build_bins(num_blocks > 0 ? 4 * side_sum / num_blocks : DEFAULT_BIN_SIZE);
+
   // Sanity check!
   for (block &b : blocks) {
     if (!legal(b)) {
@@ -230,82 +535,33 @@ bool Data::try_shift(block &b, int32_t x, int32_t y) {
     return false;
   }
   // Move gets executed
-  // Update all pin positions in nets
-  for (uint32_t n_id : b.net_ids) {
-    net &n = get_net_by_id(n_id);
-    for (size_t i = 0; i < n.pins.size(); i++) {
-      auto [id, n_x, n_y] = n.pins[i];
-      if (id != b.id) {
-        continue;
-      }
-      // No over- or underflow check needed because pin must be inside or on
-      // the edge of the block and it has already been checked in the legal()
-      // function
-      n_x += x;
-      n_y += y;
-      n.pins[i] = std::make_tuple(id, n_x, n_y);
-    }
-  }
+  log_block(b, b.x - x, b.y - y, b.len_x, b.len_y, b.corner);
+  update_bins(&b - blocks.data(), b.x - x, b.y - y, b.len_x, b.len_y);
+  mark_moved(&b - blocks.data());
+  touch_block(&b - blocks.data());
   return true;
 }
 
 bool Data::try_swap(block &b1, block &b2) {
   std::swap(b1.x, b2.x);
   std::swap(b1.y, b2.y);
-  if (!legal(b1) || !legal(b2)) {
+  // The bins still hold the old positions of both blocks, so check them
+  // against each other directly
+  if (!legal(b1, b2.id) || !legal(b2, b1.id) ||
+      (&b1 != &b2 && overlap(b1, b2))) {
     std::swap(b1.x, b2.x);
     std::swap(b1.y, b2.y);
     return false;
   }
   // Move gets executed
-  // Update all pin positions in nets
-  for (uint32_t n_id : b1.net_ids) {
-    net &n = get_net_by_id(n_id);
-    for (size_t i = 0; i < n.pins.size(); i++) {
-      auto [id, n_x, n_y] = n.pins[i];
-      if (id != b1.id) {
-        continue;
-      }
-      // No over- or underflow check needed because pin must be inside or on
-      // the edge of the block and it has already been checked in the legal()
-      // function
-      if (b1.x > b2.x) {
-        n_x += b1.x - b2.x;
-      } else {
-        n_x -= b2.x - b1.x;
-      }
-      if (b1.y > b2.y) {
-        n_y += b1.y - b2.y;
-      } else {
-        n_y -= b2.y - b1.y;
-      }
-      n.pins[i] = std::make_tuple(id, n_x, n_y);
-    }
-  }
-
-  for (uint32_t n_id : b2.net_ids) {
-    net &n = get_net_by_id(n_id);
-    for (size_t i = 0; i < n.pins.size(); i++) {
-      auto [id, n_x, n_y] = n.pins[i];
-      if (id != b2.id) {
-        continue;
-      }
-      // No over- or underflow check needed because pin must be inside or on
-      // the edge of the block and it has already been checked in the legal()
-      // function
-      if (b1.x > b2.x) {
-        n_x -= b1.x - b2.x;
-      } else {
-        n_x += b2.x - b1.x;
-      }
-      if (b1.y > b2.y) {
-        n_y -= b1.y - b2.y;
-      } else {
-        n_y += b2.y - b1.y;
-      }
-      n.pins[i] = std::make_tuple(id, n_x, n_y);
-    }
-  }
+  log_block(b1, b2.x, b2.y, b1.len_x, b1.len_y, b1.corner);
+  log_block(b2, b1.x, b1.y, b2.len_x, b2.len_y, b2.corner);
+  update_bins(&b1 - blocks.data(), b2.x, b2.y, b1.len_x, b1.len_y);
+  mark_moved(&b1 - blocks.data());
+  touch_block(&b1 - blocks.data());
+  update_bins(&b2 - blocks.data(), b1.x, b1.y, b2.len_x, b2.len_y);
+  mark_moved(&b2 - blocks.data());
+  touch_block(&b2 - blocks.data());
   return true;
 }
 
@@ -316,36 +572,13 @@ bool Data::try_rot_cw(block &b) {
     return false;
   }
   // Move gets executed
-  // Update all pin positions in nets
-  // Rotate pins
-  for (uint32_t n_id : b.net_ids) {
-    net &n = get_net_by_id(n_id);
-    for (size_t i = 0; i < n.pins.size(); i++) {
-      auto [id, n_x, n_y] = n.pins[i];
-      if (id != b.id) {
-        continue;
-      }
-      // No over- or underflow check needed because pin must be inside or on
-      // the edge of the block and it has already been checked in the legal()
-      // function
-      if (n_x == b.x) {
-        if (n_y == b.y) {
-          n_x += b.len_x - 1;
-        } else {
-          n_y = b.y;
-        }
-      } else {
-        if (n_y == b.y) {
-          n_y += b.len_y - 1;
-          n_x = b.x + b.len_x - 1;
-        } else {
-          n_x = b.x;
-          n_y = b.y + b.len_y - 1;
-        }
-      }
-      n.pins[i] = std::make_tuple(id, n_x, n_y);
-    }
-  }
+  log_block(b, b.x, b.y, b.len_y, b.len_x, b.corner);
+  update_bins(&b - blocks.data(), b.x, b.y, b.len_y, b.len_x);
+  mark_moved(&b - blocks.data());
+  // Pins go from top left to top right to bottom right to bottom left
+  b.corner = ((b.corner & CORNER_BOTTOM) ? 0 : CORNER_RIGHT) |
+             ((b.corner & CORNER_RIGHT) ? CORNER_BOTTOM : 0);
+  touch_block(&b - blocks.data());
   return true;
 }
 
@@ -356,104 +589,260 @@ bool Data::try_rot_cc(block &b) {
     return false;
   }
   // Move gets executed
-  // Update all pin positions in nets
-  // Rotate pins
-  for (uint32_t n_id : b.net_ids) {
-    net &n = get_net_by_id(n_id);
-    for (size_t i = 0; i < n.pins.size(); i++) {
-      auto [id, n_x, n_y] = n.pins[i];
-      if (id != b.id) {
-        continue;
-      }
-      // No over- or underflow check needed because pin must be inside or on
-      // the edge of the block and it has already been checked in the legal()
-      // function
-      if (n_x == b.x) {
-        if (n_y == b.y) {
-          n_y += b.len_y - 1;
-        } else {
-          n_y = b.y + b.len_y - 1;
-          n_x += b.len_x - 1;
-        }
-      } else {
-        if (n_y == b.y) {
-          n_x = b.x;
-        } else {
-          n_x = b.x + b.len_x - 1;
-          n_y = b.y;
-        }
-      }
-      n.pins[i] = std::make_tuple(id, n_x, n_y);
-    }
-  }
+  log_block(b, b.x, b.y, b.len_y, b.len_x, b.corner);
+  update_bins(&b - blocks.data(), b.x, b.y, b.len_y, b.len_x);
+  mark_moved(&b - blocks.data());
+  // Pins go from top left to bottom left to bottom right to top right
+  b.corner = ((b.corner & CORNER_BOTTOM) ? CORNER_RIGHT : 0) |
+             ((b.corner & CORNER_RIGHT) ? 0 : CORNER_BOTTOM);
+  touch_block(&b - blocks.data());
   return true;
 }
 
 bool Data::try_flip_h(block &b) {
   // Move gets executed
-  // Update all pin positions in nets
-  // Flip pins
-  for (uint32_t n_id : b.net_ids) {
-    net &n = get_net_by_id(n_id);
-    for (size_t i = 0; i < n.pins.size(); i++) {
-      auto [id, n_x, n_y] = n.pins[i];
-      if (id != b.id) {
-        continue;
-      }
-      // No over- or underflow check needed because pin must be inside or on
-      // the edge of the block and it has already been checked in the legal()
-      // function
-      if (n_x == b.x) {
-        n_x += b.len_x - 1;
-      } else {
-        n_x = b.x;
-      }
-      n.pins[i] = std::make_tuple(id, n_x, n_y);
-    }
-  }
+  log_block(b, b.x, b.y, b.len_x, b.len_y, b.corner);
+  mark_moved(&b - blocks.data());
+  b.corner ^= CORNER_RIGHT;
+  touch_block(&b - blocks.data());
   return true;
 }
 
 bool Data::try_flip_v(block &b) {
   // Move gets executed
-  // Update all pin positions in nets
-  // Flip pins
-  for (uint32_t n_id : b.net_ids) {
-    net &n = get_net_by_id(n_id);
-    for (size_t i = 0; i < n.pins.size(); i++) {
-      auto [id, n_x, n_y] = n.pins[i];
-      if (id != b.id) {
-        continue;
-      }
-      // No over- or underflow check needed because pin must be inside or on
-      // the edge of the block and it has already been checked in the legal()
-      // function
-      if (n_y == b.y) {
-        n_y += b.len_y - 1;
-      } else {
-        n_y = b.y;
-      }
-      n.pins[i] = std::make_tuple(id, n_x, n_y);
+  log_block(b, b.x, b.y, b.len_x, b.len_y, b.corner);
+  mark_moved(&b - blocks.data());
+  b.corner ^= CORNER_BOTTOM;
+  touch_block(&b - blocks.data());
+  return true;
+}
+
+void Data::begin_transaction() {
+  block_log.clear();
+  cost_journal.clear();
+  rollback_net_total = net_total;
+  rollback_total_cost = total_cost;
+  transaction_open = true;
+}
+
+void Data::commit() {
+  block_log.clear();
+  cost_journal.clear();
+  transaction_open = false;
+}
+
+void Data::rollback() {
+  // Undo in reverse order, so an entry logged twice ends up with its oldest
+  // value
+  for (auto it = block_log.rbegin(); it != block_log.rend(); it++) {
+    block &b = blocks[it->index];
+    std::swap(b.x, it->x);
+    std::swap(b.y, it->y);
+    std::swap(b.len_x, it->len_x);
+    std::swap(b.len_y, it->len_y);
+    b.corner = it->corner;
+    // The log entry now holds the geometry the bins were built with
+    update_bins(it->index, it->x, it->y, it->len_x, it->len_y);
+    // The pins may have been written with the rejected geometry
+    mark_pins_stale(it->index);
+  }
+  for (auto it = cost_journal.rbegin(); it != cost_journal.rend(); it++) {
+    net_costs[it->first] = it->second;
+  }
+  net_total = rollback_net_total;
+  total_cost = rollback_total_cost;
+  // The nets are back in the committed state, so their cached costs are valid
+  for (size_t i : dirty_nets) {
+    net_dirty[i] = false;
+  }
+  dirty_nets.clear();
+  commit();
+}
+
+void Data::log_block(block &b, uint32_t x, uint32_t y, uint32_t len_x,
+                     uint32_t len_y, uint8_t corner) {
+  if (transaction_open) {
+    block_log.push_back({static_cast<size_t>(&b - blocks.data()), x, y, len_x,
+                         len_y, corner});
+  }
+}
+
+void Data::touch_block(size_t index) {
+  for (auto [net_index, slot] : block_pins[index]) {
+    if (net_weight[net_index] != 0) {
+      mark_dirty(net_index);
     }
   }
-  return true;
+  mark_pins_stale(index);
+}
+
+void Data::mark_pins_stale(size_t index) {
+  if (!pins_stale[index]) {
+    pins_stale[index] = true;
+    stale_pin_blocks.push_back(index);
+  }
 }
 
-void Data::save_state() {
-  reset_blocks = blocks;
-  reset_nets = nets;
+void Data::update_pins() { update_pins(current_cost()); }
+
+incremental_cost &Data::current_cost() {
+  // Without a cost the pins are just written
+  return cost_model != nullptr ? *cost_model : fn_cost;
 }
 
-void Data::reset_state() {
-  std::swap(blocks, reset_blocks);
-  std::swap(nets, reset_nets);
+void Data::mark_dirty(size_t i) {
+  if (!net_dirty[i]) {
+    net_dirty[i] = true;
+    dirty_nets.push_back(i);
+  }
+}
+
+uint64_t Data::init_cost(uint64_t (*cost_fn)(const pin_span &)) {
+  fn_cost = function_cost(cost_fn);
+  return init_cost(fn_cost);
+}
+
+uint64_t Data::init_cost(incremental_cost &cost) {
+  // The cost has to start from the current pins. The old cost is replaced, so
+  // it doesn't need to know about them
+  update_pins(fn_cost);
+  cost_model = &cost;
+  cost_model->reset(num_nets);
+  net_total = 0;
+  for (size_t i = 0; i < num_nets; i++) {
+    // NOTE: Skipped nets never reach the cost. Their pins aren't followed, so
+    // state like the RUDY demand would stay at the first placement
+    net_costs[i] =
+        net_weight[i] == 0 ? 0 : weigh(i, cost_model->init_net(i, pins_of(i)));
+    net_total += net_costs[i];
+    net_dirty[i] = false;
+  }
+  dirty_nets.clear();
+  cost_journal.clear();
+  total_cost = net_total + cost_model->global_cost();
+  return total_cost;
+}
+
+uint64_t Data::update_cost() {
+  if (cost_model == nullptr) {
+    panic("Called update_cost() before init_cost()");
+  }
+  return update_cost(*cost_model);
+}
+
+uint64_t Data::get_cost() { return total_cost; }
+
+size_t Data::set_large_nets(size_t threshold, large_net_mode mode,
+                            uint32_t weight) {
+  size_t large = 0;
+  for (size_t i = 0; i < num_nets; i++) {
+    net_weight[i] = NET_WEIGHT_FULL;
+    if (pin_count[i] <= threshold) {
+      continue;
+    }
+    large++;
+    if (mode == LARGE_NETS_SKIP) {
+      net_weight[i] = 0;
+    } else if (mode == LARGE_NETS_WEIGHT) {
+      net_weight[i] = weight;
+    }
+  }
+  return large;
+}
+
+void Data::mark_moved(size_t index) {
+  if (index < best_stale.size() && !best_stale[index]) {
+    best_stale[index] = true;
+    best_stale_blocks.push_back(index);
+  }
+}
+
+void Data::save_best_block(size_t i) {
+  block &b = blocks[i];
+  best_x[i] = b.x;
+  best_y[i] = b.y;
+  best_len_x[i] = b.len_x;
+  best_len_y[i] = b.len_y;
+  best_corner[i] = b.corner;
 }
 
 void Data::save_best() {
-  best_blocks = blocks;
-  best_nets = nets;
+  if (best_x.size() != num_blocks) {
+    best_x.resize(num_blocks);
+    best_y.resize(num_blocks);
+    best_len_x.resize(num_blocks);
+    best_len_y.resize(num_blocks);
+    best_corner.resize(num_blocks);
+    best_stale.assign(num_blocks, false);
+    best_stale_blocks.clear();
+    for (size_t i = 0; i < num_blocks; i++) {
+      save_best_block(i);
+    }
+  } else {
+    // Only the blocks moved since the last call differ from the saved state
+    for (size_t i : best_stale_blocks) {
+      save_best_block(i);
+      best_stale[i] = false;
+    }
+    best_stale_blocks.clear();
+  }
+  best_pins_valid = false;
+}
+
+std::vector<block> Data::get_best_blocks() {
+  std::vector<block> best = blocks;
+  for (size_t i = 0; i < best_x.size(); i++) {
+    best[i].x = best_x[i];
+    best[i].y = best_y[i];
+    best[i].len_x = best_len_x[i];
+    best[i].len_y = best_len_y[i];
+    best[i].corner = best_corner[i];
+  }
+  return best;
 }
 
-std::vector<block> Data::get_best_blocks() { return best_blocks; }
+void Data::set_placement(const std::vector<block> &placement) {
+  for (size_t i = 0; i < num_blocks; i++) {
+    block &b = blocks[i];
+    const block &p = placement[i];
+    if (b.x == p.x && b.y == p.y && b.len_x == p.len_x && b.len_y == p.len_y &&
+        b.corner == p.corner) {
+      continue;
+    }
+    log_block(b, b.x, b.y, b.len_x, b.len_y, b.corner);
+    uint32_t x = b.x;
+    uint32_t y = b.y;
+    uint32_t len_x = b.len_x;
+    uint32_t len_y = b.len_y;
+    b.x = p.x;
+    b.y = p.y;
+    b.len_x = p.len_x;
+    b.len_y = p.len_y;
+    b.corner = p.corner;
+    update_bins(i, x, y, len_x, len_y);
+    mark_moved(i);
+    touch_block(i);
+  }
+}
 
-std::vector<net> Data::get_best_nets() { return best_nets; }
+pin_span Data::get_best_pins(size_t net_index) {
+  if (!best_pins_valid) {
+    // Input and output pins never move, so start with the current pins
+    best_pin_x = pin_x;
+    best_pin_y = pin_y;
+    for (size_t i = 0; i < best_x.size(); i++) {
+      uint32_t x = best_x[i] +
+                   ((best_corner[i] & CORNER_RIGHT) ? best_len_x[i] - 1 : 0);
+      uint32_t y = best_y[i] +
+                   ((best_corner[i] & CORNER_BOTTOM) ? best_len_y[i] - 1 : 0);
+      for (auto [n, slot] : block_pins[i]) {
+        best_pin_x[pin_begin[n] + slot] = x;
+        best_pin_y[pin_begin[n] + slot] = y;
+      }
+    }
+    best_pins_valid = true;
+  }
+  size_t begin = pin_begin[net_index];
+  return {pin_ids.data() + begin, best_pin_x.data() + begin,
+          best_pin_y.data() + begin, pin_count[net_index]};
+}
@@ -1,8 +1,11 @@
 #include "../include/input.h"
+#include "../include/panic.h"
 #include <cstdint>
 #include <utility>
 
-IO::IO(Data &data) : data(data) {
+IO::IO(Data &data)
+    : data(data), block_id_to_inst_name(&arena), block_id_to_gate_type(&arena),
+      net_name_to_id(&arena) {
   block_num = 0;
   net_num = 0;
 }
@@ -82,10 +85,10 @@ bool IO::transfer_gates(lorina::verilog_parser &parser) {
 void IO::on_inputs(const std::vector<std::string> &inputs,
                    std::string const &size) const {
   DEBUG("Reading inputs")
-  for (auto in : inputs) {
+  for (const auto &in : inputs) {
     DEBUG("Input ", net_num, " name: ", in)
-    net_name_to_id.emplace(std::make_pair(in, net_num));
-    data.add_net({.id = net_num, .pins = {}});
+    net_name_to_id.emplace(in, net_num);
+    data.add_net({.id = net_num});
     data.add_input(net_num);
     net_num++;
   }
@@ -94,10 +97,10 @@ void IO::on_inputs(const std::vector<std::string> &inputs,
 void IO::on_outputs(const std::vector<std::string> &outputs,
                     std::string const &size) const {
   DEBUG("Reading outputs")
-  for (auto out : outputs) {
+  for (const auto &out : outputs) {
     DEBUG("Output ", net_num, " name: ", out)
-    net_name_to_id.emplace(std::make_pair(out, net_num));
-    data.add_net({.id = net_num, .pins = {}});
+    net_name_to_id.emplace(out, net_num);
+    data.add_net({.id = net_num});
 		data.add_output(net_num);
     net_num++;
   }
@@ -106,10 +109,10 @@ void IO::on_outputs(const std::vector<std::string> &outputs,
 void IO::on_wires(const std::vector<std::string> &wires,
                   std::string const &size) const {
   DEBUG("Reading wires")
-  for (auto wire : wires) {
+  for (const auto &wire : wires) {
     DEBUG("Wire ", net_num, " name: ", wire)
-    net_name_to_id.emplace(std::make_pair(wire, net_num));
-    data.add_net({.id = net_num, .pins = {}});
+    net_name_to_id.emplace(wire, net_num);
+    data.add_net({.id = net_num});
     net_num++;
   }
 }
@@ -120,20 +123,24 @@ void IO::on_module_instantiation(
     std::vector<std::pair<std::string, std::string>> const &args) const {
 
   DEBUG("Instantiating module ", inst_name, " of type ", module_name)
-  genlib_gate type = gate_types.at(module_name);
+  const genlib_gate &type = gate_types.at(module_name);
   uint64_t id = block_num;
-  block_id_to_inst_name.insert(std::make_pair(id, inst_name));
-  block_id_to_gate_type.insert(std::make_pair(id, type.name));
-
-  block b = {.id = id,
-             .x = 0,
-             .y = 0,
-             .len_x = type.len_x,
-             .len_y = type.len_y,
-             .net_ids = {}};
-  for (auto [mod_sig, inst_sig] : args) {
-    uint64_t net_id = net_name_to_id.at(inst_sig);
-    b.net_ids.emplace_back(net_id);
+  block_id_to_inst_name.emplace(id, inst_name);
+  block_id_to_gate_type.emplace(id, &type);
+
+  block &b = new_block;
+  b.id = id;
+  b.x = 0;
+  b.y = 0;
+  b.len_x = type.len_x;
+  b.len_y = type.len_y;
+  b.net_ids.clear();
+  for (const auto &[mod_sig, inst_sig] : args) {
+    auto it = net_name_to_id.find(std::string_view(inst_sig));
+    if (it == net_name_to_id.end()) {
+      panic("Instance " + inst_name + " uses unknown net " + inst_sig);
+    }
+    b.net_ids.emplace_back(it->second);
   }
 
   data.add_block(b);
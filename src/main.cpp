@@ -6,7 +6,7 @@
 #include <cmath>
 #include <cstdint>
 #include <fstream>
-#include <functional>
+#include <random>
 #include <string>
 
 int main(int argc, char **argv) {
@@ -19,8 +19,20 @@ int main(int argc, char **argv) {
   options.add_options()("g,genlib", "Genlib File",
                         cxxopts::value<std::string>())(
       "v,verilog", "Verilog File", cxxopts::value<std::string>())(
-      "cf,cost_function", "Cost function (hpwl, mcl, star)",
+      "cf,cost_function",
+      "Cost function (hpwl, mcl, star, rsmt), append +rudy to add congestion",
       cxxopts::value<std::string>()->default_value("hpwl"))(
+      "lt,large_net_threshold",
+      "Nets with more pins are handled by the large net mode, 0 for none",
+      cxxopts::value<size_t>()->default_value("0"))(
+      "lm,large_net_mode", "Large net mode (keep, skip, weight)",
+      cxxopts::value<std::string>()->default_value("keep"))(
+      "lw,large_net_weight", "Weight of large nets in percent for weight mode",
+      cxxopts::value<uint32_t>()->default_value("10"))(
+      "rw,rudy_weight", "Weight of the congestion cost of +rudy",
+      cxxopts::value<uint64_t>()->default_value("1"))(
+      "rb,rudy_bin_size", "Edge length of the congestion bins of +rudy",
+      cxxopts::value<uint32_t>()->default_value("32"))(
       "cx,chip_x", "Chip size in x-dimension",
       cxxopts::value<uint32_t>()->default_value("200"))(
       "cy,chip_y", "Chip size in y-dimension",
@@ -53,6 +65,29 @@ int main(int argc, char **argv) {
       "fmps, final_moves_per_step",
       "Final number of individual moves executed per annealing step",
       cxxopts::value<uint32_t>()->default_value("1"))(
+      "pm,per_move",
+      "Accept or reject every move on its own instead of all moves of a step",
+      cxxopts::value<bool>()->default_value("false"))(
+      "pt,replicas",
+      "Number of replicas for parallel tempering, 0 for plain annealing",
+      cxxopts::value<uint32_t>()->default_value("0"))(
+      "ei,exchange_interval",
+      "Steps between swap attempts of the parallel tempering replicas",
+      cxxopts::value<uint64_t>()->default_value("100"))(
+      "is,islands",
+      "Number of independently annealed islands, 0 for plain annealing",
+      cxxopts::value<uint32_t>()->default_value("0"))(
+      "mi,migration_interval",
+      "Steps between migrations of the best placement to the worse islands",
+      cxxopts::value<uint64_t>()->default_value("1000"))(
+      "sp,speculative_threads",
+      "Threads that evaluate batches of moves in parallel, 0 for plain "
+      "annealing",
+      cxxopts::value<uint32_t>()->default_value("0"))(
+      "sb,speculative_batch", "Moves per batch of the speculative evaluation",
+      cxxopts::value<uint32_t>()->default_value("64"))(
+      "seed", "Seed of the random numbers, random if not given",
+      cxxopts::value<uint64_t>())(
       "ld,log_dir", "Path to log directory",
       cxxopts::value<std::string>()->default_value("log/"))(
       "lf,log_file", "File prefix for logs",
@@ -87,18 +122,88 @@ int main(int argc, char **argv) {
   uint32_t initial_moves_per_step =
       result["initial_moves_per_step"].as<uint32_t>();
   uint32_t final_moves_per_step = result["final_moves_per_step"].as<uint32_t>();
+  bool per_move = result["per_move"].as<bool>();
+  uint64_t seed = result.count("seed") ? result["seed"].as<uint64_t>()
+                                       : std::random_device()();
+  Xoshiro256pp rng(seed);
+  uint32_t replicas = result["replicas"].as<uint32_t>();
+  uint64_t exchange_interval = result["exchange_interval"].as<uint64_t>();
+  uint32_t islands = result["islands"].as<uint32_t>();
+  uint64_t migration_interval = result["migration_interval"].as<uint64_t>();
+  uint32_t speculative_threads = result["speculative_threads"].as<uint32_t>();
+  uint32_t speculative_batch = result["speculative_batch"].as<uint32_t>();
+  if ((replicas > 0) + (islands > 0) + (speculative_threads > 0) > 1) {
+    ERROR("Parallel tempering, islands and speculative evaluation can't be "
+          "combined")
+    return 2;
+  }
   bool logging_enabled = true;
 
   auto cf = result["cost_function"].as<std::string>();
-  std::function<uint64_t(Data &)> cost_fn = hpwl;
+  // All cost functions follow the moved pins instead of evaluating every
+  // touched net again
+  hpwl_cost hpwl_model;
+  mcl_cost mcl_model;
+  star_cost star_model;
+  rsmt_cost rsmt_model;
+  uint64_t rudy_weight = result["rudy_weight"].as<uint64_t>();
+  uint32_t rudy_bin_size = result["rudy_bin_size"].as<uint32_t>();
+  if (rudy_bin_size == 0) {
+    ERROR("The RUDY bin size has to be at least 1")
+    return 2;
+  }
+  rudy_cost<hpwl_cost> hpwl_rudy_model(chip_x, chip_y, rudy_weight,
+                                       rudy_bin_size);
+  rudy_cost<mcl_cost> mcl_rudy_model(chip_x, chip_y, rudy_weight,
+                                     rudy_bin_size);
+  rudy_cost<star_cost> star_rudy_model(chip_x, chip_y, rudy_weight,
+                                       rudy_bin_size);
+  rudy_cost<rsmt_cost> rsmt_rudy_model(chip_x, chip_y, rudy_weight,
+                                       rudy_bin_size);
+  incremental_cost *cost_model = nullptr;
   if (cf == "hpwl") {
-    cost_fn = hpwl;
+    cost_model = &hpwl_model;
   } else if (cf == "mcl") {
-    cost_fn = mcl;
+    cost_model = &mcl_model;
   } else if (cf == "star") {
-    cost_fn = star;
+    cost_model = &star_model;
+  } else if (cf == "rsmt") {
+    cost_model = &rsmt_model;
+  } else if (cf == "hpwl+rudy") {
+    cost_model = &hpwl_rudy_model;
+  } else if (cf == "mcl+rudy") {
+    cost_model = &mcl_rudy_model;
+  } else if (cf == "star+rudy") {
+    cost_model = &star_rudy_model;
+  } else if (cf == "rsmt+rudy") {
+    cost_model = &rsmt_rudy_model;
+  } else {
+    ERROR("No valid cost function selected. Chose one of hpwl, mcl, star or "
+          "rsmt, optionally followed by +rudy")
+    return 2;
+  }
+
+  // Plain cost of a single net, used for the degree statistics
+  uint64_t (*net_fn)(const pin_span &) = hpwl_net;
+  if (cf.starts_with("mcl")) {
+    net_fn = mcl_net;
+  } else if (cf.starts_with("star")) {
+    net_fn = star_net;
+  } else if (cf.starts_with("rsmt")) {
+    net_fn = rsmt_net;
+  }
+
+  size_t large_net_threshold = result["large_net_threshold"].as<size_t>();
+  auto lm = result["large_net_mode"].as<std::string>();
+  large_net_mode large_mode;
+  if (lm == "keep") {
+    large_mode = LARGE_NETS_KEEP;
+  } else if (lm == "skip") {
+    large_mode = LARGE_NETS_SKIP;
+  } else if (lm == "weight") {
+    large_mode = LARGE_NETS_WEIGHT;
   } else {
-    ERROR("No valid cost function selected. Chose one of hpwl, mcl or star")
+    ERROR("No valid large net mode selected. Chose one of keep, skip or weight")
     return 2;
   }
 
@@ -149,13 +254,21 @@ int main(int argc, char **argv) {
           "area.");
   }
 
+  log_net_degrees(data, net_fn);
+  if (large_net_threshold > 0) {
+    size_t large = data.set_large_nets(large_net_threshold, large_mode,
+                                       result["large_net_weight"].as<uint32_t>());
+    LOG_INFO(large, " nets have more than ", large_net_threshold, " pins")
+  }
+
   // 3. annealing
   [[maybe_unused]]
-  uint64_t initial_cost = cost_fn(data);
+  uint64_t initial_cost = data.init_cost(*cost_model);
   [[maybe_unused]]
   uint64_t final_cost;
 
   LOG_INFO("Initial cost: ", initial_cost);
+  LOG_INFO("Seed: ", seed);
   if (steps == 0) {
     LOG_INFO("No annealing steps")
     return 0;
@@ -165,10 +278,54 @@ int main(int argc, char **argv) {
   save_pgm(data, logger);
   logger.file_prefix = result["log_file"].as<std::string>();
 
-  final_cost = anneal(data, cost_fn, initial_temp, final_temp, initial_window_x,
-                      final_window_x, initial_window_y, final_window_y, steps,
-                      warmup_steps, tuning_steps, initial_moves_per_step,
-                      final_moves_per_step, logging_enabled, logger);
+  // Dispatch on the cost function once, anneal() is compiled for each of them
+  auto run = [&](auto &model) {
+    if (replicas > 0) {
+      return anneal_tempering(
+          data, model, rng, replicas, exchange_interval, initial_temp, final_temp,
+          initial_window_x, final_window_x, initial_window_y, final_window_y,
+          steps, warmup_steps, tuning_steps, initial_moves_per_step,
+          final_moves_per_step, per_move, logging_enabled, logger);
+    }
+    if (islands > 0) {
+      return anneal_islands(
+          data, model, rng, islands, migration_interval, initial_temp,
+          final_temp, initial_window_x, final_window_x, initial_window_y,
+          final_window_y, steps, warmup_steps, tuning_steps,
+          initial_moves_per_step, final_moves_per_step, per_move,
+          logging_enabled, logger);
+    }
+    if (speculative_threads > 0) {
+      return anneal_speculative(
+          data, model, rng, speculative_threads, speculative_batch,
+          initial_temp, final_temp, initial_window_x, final_window_x,
+          initial_window_y, final_window_y, steps, warmup_steps, tuning_steps,
+          initial_moves_per_step, final_moves_per_step, logging_enabled,
+          logger);
+    }
+    return anneal(data, model, rng, initial_temp, final_temp,
+                  initial_window_x, final_window_x, initial_window_y,
+                  final_window_y, steps, warmup_steps, tuning_steps,
+                  initial_moves_per_step, final_moves_per_step, per_move,
+                  logging_enabled, logger);
+  };
+  if (cf == "hpwl") {
+    final_cost = run(hpwl_model);
+  } else if (cf == "mcl") {
+    final_cost = run(mcl_model);
+  } else if (cf == "star") {
+    final_cost = run(star_model);
+  } else if (cf == "rsmt") {
+    final_cost = run(rsmt_model);
+  } else if (cf == "hpwl+rudy") {
+    final_cost = run(hpwl_rudy_model);
+  } else if (cf == "mcl+rudy") {
+    final_cost = run(mcl_rudy_model);
+  } else if (cf == "star+rudy") {
+    final_cost = run(star_rudy_model);
+  } else {
+    final_cost = run(rsmt_rudy_model);
+  }
   // 4. present results
   logger.file_prefix.append("_final");
   save_pgm(data, logger);
@@ -0,0 +1,140 @@
+// Microbenchmark of the random numbers of try_random_move(). Compares reducing
+// with % against Xoshiro256pp::bounded(), first for the numbers alone and then
+// for whole moves that are rolled back again. Last, anneal_speculative() runs
+// the same number of moves with 1 to threads threads.
+// Usage: move_bench [moves] [threads]
+
+#include "../include/annealing.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+// try_random_move() as it was before bounded(), kept as the baseline
+static bool try_random_move_modulo(Data &data, Xoshiro256pp &rng,
+                                   uint32_t window_x, uint32_t window_y) {
+  move move = static_cast<enum move>(rng() % LAST);
+  uint64_t range;
+  switch (move) {
+  case SHIFT: {
+    block &b = data.get_block_by_index(rng() % data.num_blocks);
+    range = 2 * window_x + 1;
+    int32_t x_move = static_cast<int32_t>(rng() % range) -
+                     static_cast<int32_t>(window_x);
+    range = 2 * window_y + 1;
+    int32_t y_move = static_cast<int32_t>(rng() % range) -
+                     static_cast<int32_t>(window_y);
+    return data.try_shift(b, x_move, y_move);
+  }
+  case SWAP: {
+    block &b1 = data.get_block_by_index(rng() % data.num_blocks);
+    block &b2 = data.get_block_by_index(rng() % data.num_blocks);
+    return data.try_swap(b1, b2);
+  }
+  case FLIP_H:
+    return data.try_flip_h(data.get_block_by_index(rng() % data.num_blocks));
+  case FLIP_V:
+    return data.try_flip_v(data.get_block_by_index(rng() % data.num_blocks));
+  case ROT_CW:
+    return data.try_rot_cw(data.get_block_by_index(rng() % data.num_blocks));
+  default:
+    return data.try_rot_cc(data.get_block_by_index(rng() % data.num_blocks));
+  }
+}
+
+template <class F> static double seconds(F f) {
+  auto start = std::chrono::steady_clock::now();
+  f();
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+int main(int argc, char **argv) {
+  uint64_t moves = argc > 1 ? std::stoull(argv[1]) : 10'000'000;
+  uint32_t max_threads =
+      argc > 2 ? static_cast<uint32_t>(std::stoul(argv[2]))
+               : std::max(std::thread::hardware_concurrency(), 1u);
+  const uint32_t window_x = 30;
+  const uint32_t window_y = 35;
+
+  // Roughly the size of arbiter.v on a 250 x 180 chip
+  Data data(250, 180);
+  const uint64_t num_nets = 1300;
+  for (uint64_t i = 0; i < num_nets; i++) {
+    data.add_net({i});
+  }
+  Xoshiro256pp rng(1);
+  for (uint64_t id = 0; id < 1200; id++) {
+    data.add_block({id, 0, 0, 1 + static_cast<uint32_t>(rng() % 3), 1,
+                    {rng() % num_nets, rng() % num_nets, rng() % num_nets}});
+  }
+  if (!data.find_initial_placement()) {
+    fprintf(stderr, "Couldn't place the blocks\n");
+    return 1;
+  }
+  hpwl_cost model;
+  data.init_cost(model);
+
+  move_ranges ranges(data, window_x, window_y);
+  uint64_t sink = 0;
+  double modulo = seconds([&] {
+    for (uint64_t i = 0; i < moves; i++) {
+      sink += rng() % LAST + rng() % data.num_blocks +
+              rng() % (2 * window_x + 1) + rng() % (2 * window_y + 1);
+    }
+  });
+  double bounded = seconds([&] {
+    for (uint64_t i = 0; i < moves; i++) {
+      sink += rng.bounded(ranges.moves) + rng.bounded(ranges.blocks) +
+              rng.bounded(ranges.shift_x) + rng.bounded(ranges.shift_y);
+    }
+  });
+  printf("Numbers of a shift, %%:        %6.2f ns\n", 1e9 * modulo / moves);
+  printf("Numbers of a shift, bounded(): %6.2f ns\n", 1e9 * bounded / moves);
+
+  // The moves are rolled back, so both loops see the same placement
+  auto run = [&](auto try_move) {
+    return seconds([&] {
+      for (uint64_t i = 0; i < moves; i++) {
+        data.begin_transaction();
+        sink += try_move() ? 1 : 0;
+        data.rollback();
+      }
+    });
+  };
+  modulo = run([&] {
+    return try_random_move_modulo(data, rng, window_x, window_y);
+  });
+  bounded = run([&] { return try_random_move(data, rng, ranges); });
+  printf("Moves per second, %%:          %6.2f M\n", moves / modulo / 1e6);
+  printf("Moves per second, bounded():  %6.2f M\n", moves / bounded / 1e6);
+
+  // Every run starts from the same placement and stream. The moves are kept
+  // this time, so the batches grow and shrink like they do in neal. The moves
+  // per step go down from 199 to 1, about 100 on average. Illegal moves are
+  // drawn on top of them, but not counted
+  const uint32_t moves_per_step = 100;
+  struct log logger = {"", "", 0, UINT64_MAX, 1};
+  for (uint32_t threads = 1; threads <= max_threads; threads++) {
+    Data copy = data;
+    hpwl_cost copy_model;
+    copy.init_cost(copy_model);
+    Xoshiro256pp stream(2);
+    uint64_t best;
+    double speculative = seconds([&] {
+      best = anneal_speculative(copy, copy_model, stream, threads, 64, 1000, 50,
+                                window_x, 1, window_y, 1,
+                                moves / moves_per_step, 0, 0,
+                                2 * moves_per_step - 1, 1, false, logger);
+    });
+    sink += best;
+    printf("Speculative moves per second, %2u threads: %6.2f M\n", threads,
+           moves / speculative / 1e6);
+  }
+  // Keeps the loops from being optimized away
+  return sink == 0 ? 1 : 0;
+}
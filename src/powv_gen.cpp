@@ -0,0 +1,164 @@
+// Generates the lookup tables of rsmt_net(). Run by the build, writes the
+// tables to the file given as the first argument
+//
+// The length of a rectilinear Steiner minimal tree only depends on the order
+// of the pins in x and y and on the gaps between neighboring coordinates. For
+// a net of degree n, pin i in x order has the y rank perm[i]. Every Steiner
+// tree of the pins uses each of the n - 1 horizontal and n - 1 vertical gaps a
+// whole number of times, so its length is the dot product of this wirelength
+// vector with the gaps. The tables hold, for every degree and permutation, all
+// vectors that are minimal for some gaps (potentially optimal wirelength
+// vectors, POWV). The tree length is then the smallest dot product of them
+//
+// The vectors come from the Dreyfus-Wagner algorithm on the Hanan grid of the
+// pins, with sets of vectors instead of lengths. Every vector that is
+// dominated by another one in all gaps is dropped
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <vector>
+
+#define POWV_MAX_DEGREE 6
+
+typedef std::vector<uint8_t> wl_vector;
+typedef std::vector<wl_vector> wl_set;
+
+static bool dominates(const wl_vector &a, const wl_vector &b) {
+  for (size_t i = 0; i < a.size(); i++) {
+    if (a[i] > b[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Adds v to set unless it is dominated, removes what v dominates
+static void insert(wl_set &set, const wl_vector &v) {
+  for (const wl_vector &w : set) {
+    if (dominates(w, v)) {
+      return;
+    }
+  }
+  std::erase_if(set, [&](const wl_vector &w) { return dominates(v, w); });
+  set.push_back(v);
+}
+
+// Vector of the shortest path between two Hanan grid nodes, every gap between
+// them is crossed once
+static wl_vector path(size_t n, size_t from_x, size_t from_y, size_t to_x,
+                      size_t to_y) {
+  wl_vector v(2 * (n - 1), 0);
+  for (size_t i = std::min(from_x, to_x); i < std::max(from_x, to_x); i++) {
+    v[i]++;
+  }
+  for (size_t i = std::min(from_y, to_y); i < std::max(from_y, to_y); i++) {
+    v[n - 1 + i]++;
+  }
+  return v;
+}
+
+static wl_vector add(const wl_vector &a, const wl_vector &b) {
+  wl_vector v(a.size());
+  for (size_t i = 0; i < a.size(); i++) {
+    v[i] = a[i] + b[i];
+  }
+  return v;
+}
+
+static wl_set powvs(const std::vector<size_t> &perm) {
+  size_t n = perm.size();
+  size_t nodes = n * n;
+  // The last pin is the root, the subsets are over the others
+  size_t terminals = n - 1;
+  size_t subsets = size_t(1) << terminals;
+  // Grid node of (x, y) is y * n + x
+  std::vector<wl_set> dp(subsets * nodes);
+  for (size_t t = 0; t < terminals; t++) {
+    for (size_t node = 0; node < nodes; node++) {
+      dp[(size_t(1) << t) * nodes + node] = {
+          path(n, t, perm[t], node % n, node / n)};
+    }
+  }
+  for (size_t s = 1; s < subsets; s++) {
+    if ((s & (s - 1)) == 0) {
+      continue;
+    }
+    // Trees for s that split at a node
+    std::vector<wl_set> merged(nodes);
+    size_t low = s & -s;
+    for (size_t sub = (s - 1) & s; sub > 0; sub = (sub - 1) & s) {
+      // Each split once
+      if ((sub & low) == 0) {
+        continue;
+      }
+      for (size_t node = 0; node < nodes; node++) {
+        for (const wl_vector &a : dp[sub * nodes + node]) {
+          for (const wl_vector &b : dp[(s ^ sub) * nodes + node]) {
+            insert(merged[node], add(a, b));
+          }
+        }
+      }
+    }
+    for (size_t node = 0; node < nodes; node++) {
+      wl_set &set = dp[s * nodes + node];
+      for (size_t from = 0; from < nodes; from++) {
+        wl_vector p = path(n, from % n, from / n, node % n, node / n);
+        for (const wl_vector &a : merged[from]) {
+          insert(set, add(a, p));
+        }
+      }
+    }
+  }
+  return dp[(subsets - 1) * nodes + perm[n - 1] * n + (n - 1)];
+}
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: powv_gen <output file>\n");
+    return 2;
+  }
+  FILE *out = fopen(argv[1], "w");
+  if (out == nullptr) {
+    fprintf(stderr, "Couldn't open %s\n", argv[1]);
+    return 2;
+  }
+  fprintf(out, "// Generated by powv_gen, do not edit\n\n");
+  fprintf(out, "#define POWV_MAX_DEGREE %d\n\n", POWV_MAX_DEGREE);
+  for (size_t n = 2; n <= POWV_MAX_DEGREE; n++) {
+    std::vector<size_t> perm(n);
+    std::iota(perm.begin(), perm.end(), 0);
+    std::vector<uint32_t> begin = {0};
+    std::vector<uint8_t> coefficients;
+    // Lexicographic order is the order of the permutation index
+    do {
+      for (const wl_vector &v : powvs(perm)) {
+        coefficients.insert(coefficients.end(), v.begin(), v.end());
+      }
+      begin.push_back(coefficients.size() / (2 * (n - 1)));
+    } while (std::next_permutation(perm.begin(), perm.end()));
+    fprintf(out, "static const uint32_t powv_begin_%zu[] = {", n);
+    for (size_t i = 0; i < begin.size(); i++) {
+      fprintf(out, "%s%u,", i % 16 == 0 ? "\n    " : " ", begin[i]);
+    }
+    fprintf(out, "};\n\nstatic const uint8_t powv_%zu[] = {", n);
+    for (size_t i = 0; i < coefficients.size(); i++) {
+      fprintf(out, "%s%u,", i % 24 == 0 ? "\n    " : " ", coefficients[i]);
+    }
+    fprintf(out, "};\n\n");
+  }
+  fprintf(out,
+          "static const uint32_t *const powv_begin[] = {nullptr, nullptr");
+  for (size_t n = 2; n <= POWV_MAX_DEGREE; n++) {
+    fprintf(out, ", powv_begin_%zu", n);
+  }
+  fprintf(out, "};\n\nstatic const uint8_t *const powv[] = {nullptr, nullptr");
+  for (size_t n = 2; n <= POWV_MAX_DEGREE; n++) {
+    fprintf(out, ", powv_%zu", n);
+  }
+  fprintf(out, "};\n");
+  fclose(out);
+  return 0;
+}
@@ -39,10 +39,9 @@ void save_pgm(Data &d, const log &logger) {
   }
   // Iterate through nets and color pins
   for (size_t i = 0; i < d.num_nets; i++) {
-    net &n = d.get_net_by_index(i);
-    for (size_t j = 0; j < n.pins.size(); j++) {
-      auto [id, n_x, n_y] = n.pins[j];
-      color_rectangle(image, n_x, 1, n_y, 1, image_width,
+    pin_span pins = d.get_pins(i);
+    for (size_t j = 0; j < pins.size; j++) {
+      color_rectangle(image, pins.x[j], 1, pins.y[j], 1, image_width,
                       logger.units_per_pixel, PIN_COLOR);
     }
   }
@@ -16,93 +16,78 @@ ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR
 IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE. */
 
 #include "../include/xoshiro256pp.h"
-#include <stdint.h>
-
-static uint64_t xo_s[4];
-
-void xo_init_state(uint64_t a, uint64_t b, uint64_t c, uint64_t d) {
-  xo_s[0] = a;
-  xo_s[1] = b;
-  xo_s[2] = c;
-  xo_s[3] = d;
+#include <cstdint>
+
+Xoshiro256pp::Xoshiro256pp(uint64_t seed) {
+  for (uint64_t &word : s) {
+    uint64_t z = (seed += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    word = z ^ (z >> 31);
+  }
 }
 
-static inline uint64_t xo_rotl(const uint64_t x, int k) {
-  return (x << k) | (x >> (64 - k));
+Xoshiro256pp::Xoshiro256pp(uint64_t a, uint64_t b, uint64_t c, uint64_t d) {
+  s[0] = a;
+  s[1] = b;
+  s[2] = c;
+  s[3] = d;
 }
 
-uint64_t xo_next(void) {
-  const uint64_t result = xo_rotl(xo_s[0] + xo_s[3], 23) + xo_s[0];
-
-  const uint64_t t = xo_s[1] << 17;
-
-  xo_s[2] ^= xo_s[0];
-  xo_s[3] ^= xo_s[1];
-  xo_s[1] ^= xo_s[2];
-  xo_s[0] ^= xo_s[3];
-
-  xo_s[2] ^= t;
-
-  xo_s[3] = xo_rotl(xo_s[3], 45);
-
-  return result;
+void Xoshiro256pp::fill(std::span<uint64_t> out) {
+  // Every number depends on the one before, so the best a single stream can
+  // do is keeping the state in registers instead of writing it back each time
+  uint64_t s0 = s[0];
+  uint64_t s1 = s[1];
+  uint64_t s2 = s[2];
+  uint64_t s3 = s[3];
+  for (uint64_t &value : out) {
+    value = rotl(s0 + s3, 23) + s0;
+    const uint64_t t = s1 << 17;
+    s2 ^= s0;
+    s3 ^= s1;
+    s1 ^= s2;
+    s0 ^= s3;
+    s2 ^= t;
+    s3 = rotl(s3, 45);
+  }
+  s[0] = s0;
+  s[1] = s1;
+  s[2] = s2;
+  s[3] = s3;
 }
 
-/* This is the jump function for the generator. It is equivalent
-   to 2^128 calls to next(); it can be used to generate 2^128
-   non-overlapping subsequences for parallel computations. */
-
-void xo_jump(void) {
-  static const uint64_t JUMP[] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c,
-                                  0xa9582618e03fc9aa, 0x39abdc4529b1661c};
-
+void Xoshiro256pp::jump(const uint64_t (&polynomial)[4]) {
   uint64_t s0 = 0;
   uint64_t s1 = 0;
   uint64_t s2 = 0;
   uint64_t s3 = 0;
-  for (std::size_t i = 0; i < sizeof JUMP / sizeof *JUMP; i++)
+  for (uint64_t word : polynomial) {
     for (int b = 0; b < 64; b++) {
-      if (JUMP[i] & UINT64_C(1) << b) {
-        s0 ^= xo_s[0];
-        s1 ^= xo_s[1];
-        s2 ^= xo_s[2];
-        s3 ^= xo_s[3];
+      if (word & UINT64_C(1) << b) {
+        s0 ^= s[0];
+        s1 ^= s[1];
+        s2 ^= s[2];
+        s3 ^= s[3];
       }
-      xo_next();
+      next();
     }
+  }
 
-  xo_s[0] = s0;
-  xo_s[1] = s1;
-  xo_s[2] = s2;
-  xo_s[3] = s3;
+  s[0] = s0;
+  s[1] = s1;
+  s[2] = s2;
+  s[3] = s3;
 }
 
-/* This is the long-jump function for the generator. It is equivalent to
-   2^192 calls to next(); it can be used to generate 2^64 starting points,
-   from each of which jump() will generate 2^64 non-overlapping
-   subsequences for parallel distributed computations. */
+void Xoshiro256pp::jump() {
+  static const uint64_t JUMP[] = {0x180ec6d33cfd0aba, 0xd5a61266f0c9392c,
+                                  0xa9582618e03fc9aa, 0x39abdc4529b1661c};
+  jump(JUMP);
+}
 
-void xo_long_jump(void) {
+void Xoshiro256pp::long_jump() {
   static const uint64_t LONG_JUMP[] = {0x76e15d3efefdcbbf, 0xc5004e441c522fb3,
                                        0x77710069854ee241, 0x39109bb02acbe635};
-
-  uint64_t s0 = 0;
-  uint64_t s1 = 0;
-  uint64_t s2 = 0;
-  uint64_t s3 = 0;
-  for (std::size_t i = 0; i < sizeof LONG_JUMP / sizeof *LONG_JUMP; i++)
-    for (int b = 0; b < 64; b++) {
-      if (LONG_JUMP[i] & UINT64_C(1) << b) {
-        s0 ^= xo_s[0];
-        s1 ^= xo_s[1];
-        s2 ^= xo_s[2];
-        s3 ^= xo_s[3];
-      }
-      xo_next();
-    }
-
-  xo_s[0] = s0;
-  xo_s[1] = s1;
-  xo_s[2] = s2;
-  xo_s[3] = s3;
+  jump(LONG_JUMP);
 }
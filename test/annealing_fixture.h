@@ -0,0 +1,20 @@
+#pragma once
+
+#include "../include/annealing.h"
+#include "doctest.h"
+#include <cstdint>
+
+// Logger of the annealing tests, its interval never runs out
+inline const struct log quiet_log = {"", "", 0, UINT64_MAX, 1};
+
+// Small netlist for the annealing drivers. Every block is 2 by 2 and on the
+// nets id % nets and (id * 5 + 2) % nets
+inline void annealing_netlist(Data &data, uint64_t nets, uint64_t blocks) {
+  for (uint64_t i = 0; i < nets; i++) {
+    data.add_net({i});
+  }
+  for (uint64_t id = 0; id < blocks; id++) {
+    data.add_block({id, 0, 0, 2, 2, {id % nets, (id * 5 + 2) % nets}});
+  }
+  REQUIRE(data.find_initial_placement());
+}
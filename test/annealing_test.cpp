@@ -1,4 +1,500 @@
 #include "doctest.h"
 #include "../include/annealing.h"
+#include "annealing_fixture.h"
+#include "random_transactions.h"
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
 
 // Annealing Tests
+TEST_CASE("Incremental cost") {
+  Data data(30, 30);
+  data.add_net({0});
+  data.add_net({1});
+  data.add_net({2});
+
+  data.add_block({10, 1, 1, 2, 3, {0, 1}});
+  data.add_block({11, 5, 1, 2, 2, {0}});
+  data.add_block({12, 9, 2, 1, 1, {0, 2}});
+  data.add_block({13, 12, 12, 2, 3, {1, 2}});
+
+  SUBCASE("hpwl") {
+    CHECK_EQ(data.init_cost(hpwl_net), hpwl(data));
+
+    CHECK(data.try_shift(data.get_block_by_id(10), 3, 10));
+    CHECK_EQ(data.update_cost(), hpwl(data));
+    CHECK(data.try_swap(data.get_block_by_id(11), data.get_block_by_id(13)));
+    CHECK(data.try_rot_cw(data.get_block_by_id(13)));
+    CHECK_EQ(data.update_cost(), hpwl(data));
+  }
+
+  SUBCASE("hpwl_cost") {
+    hpwl_cost model;
+    CHECK_EQ(data.init_cost(model), hpwl(data));
+
+    CHECK(data.try_shift(data.get_block_by_id(10), 0, 10));
+    CHECK_EQ(data.update_cost(), hpwl(data));
+    // Block 10 is the only pin on the left edge of net 0
+    CHECK(data.try_shift(data.get_block_by_id(10), 3, 0));
+    CHECK(data.try_rot_cc(data.get_block_by_id(13)));
+    CHECK_EQ(data.update_cost(), hpwl(data));
+  }
+
+  SUBCASE("star") {
+    CHECK_EQ(data.init_cost(star_net), star(data));
+
+    CHECK(data.try_flip_h(data.get_block_by_id(10)));
+    CHECK(data.try_shift(data.get_block_by_id(12), 4, 7));
+    CHECK_EQ(data.update_cost(), star(data));
+  }
+
+  SUBCASE("star_cost") {
+    star_cost model;
+    CHECK_EQ(data.init_cost(model), star(data));
+
+    // Block 10 is the root of nets 0 and 1
+    CHECK(data.try_flip_h(data.get_block_by_id(10)));
+    CHECK(data.try_shift(data.get_block_by_id(12), 4, 7));
+    CHECK_EQ(data.update_cost(), star(data));
+    CHECK(data.try_shift(data.get_block_by_id(13), 1, 1));
+    CHECK_EQ(data.update_cost(), star(data));
+  }
+
+  SUBCASE("mcl") {
+    mcl_cost model;
+    CHECK_EQ(data.init_cost(model), mcl(data));
+
+    CHECK(data.try_shift(data.get_block_by_id(12), 10, 15));
+    CHECK_EQ(data.update_cost(), mcl(data));
+    CHECK(data.try_swap(data.get_block_by_id(10), data.get_block_by_id(13)));
+    CHECK(data.try_flip_v(data.get_block_by_id(11)));
+    CHECK_EQ(data.update_cost(), mcl(data));
+
+    data.begin_transaction();
+    CHECK(data.try_rot_cw(data.get_block_by_id(13)));
+    CHECK(data.try_shift(data.get_block_by_id(11), 7, 0));
+    data.update_cost();
+    data.rollback();
+    CHECK_EQ(data.get_cost(), mcl(data));
+    CHECK(data.try_shift(data.get_block_by_id(12), -9, 0));
+    CHECK_EQ(data.update_cost(), mcl(data));
+  }
+
+  SUBCASE("Rollback restores cost") {
+    uint64_t cost = data.init_cost(hpwl_net);
+    data.begin_transaction();
+    CHECK(data.try_shift(data.get_block_by_id(12), 10, 15));
+    CHECK(data.try_rot_cc(data.get_block_by_id(10)));
+    CHECK_NE(data.update_cost(), cost);
+    CHECK(data.try_shift(data.get_block_by_id(12), -3, 2));
+    data.update_cost();
+    data.rollback();
+    CHECK_EQ(data.get_cost(), cost);
+    CHECK_EQ(hpwl(data), cost);
+    // Cached net costs must also be back in sync
+    CHECK(data.try_shift(data.get_block_by_id(11), 0, 3));
+    CHECK_EQ(data.update_cost(), hpwl(data));
+  }
+}
+
+TEST_CASE("Cost kernels") {
+  std::mt19937_64 rng(7);
+  std::vector<uint64_t> ids(300, 0);
+  std::vector<uint32_t> x(300);
+  std::vector<uint32_t> y(300);
+  for (size_t size = 0; size <= 300; size += (size < 40 ? 1 : 37)) {
+    for (size_t i = 0; i < size; i++) {
+      x[i] = rng() % 100'000;
+      y[i] = rng() % 100'000;
+    }
+    uint64_t expected = 0;
+    if (size > 1) {
+      expected = (*std::max_element(x.begin(), x.begin() + size) -
+                  *std::min_element(x.begin(), x.begin() + size)) +
+                 (*std::max_element(y.begin(), y.begin() + size) -
+                  *std::min_element(y.begin(), y.begin() + size));
+    }
+    CAPTURE(size);
+    CHECK_EQ(hpwl_net({ids.data(), x.data(), y.data(), size}), expected);
+
+    uint64_t expected_star = 0;
+    for (size_t i = 1; i < size; i++) {
+      expected_star += (x[i] > x[0] ? x[i] - x[0] : x[0] - x[i]) +
+                       (y[i] > y[0] ? y[i] - y[0] : y[0] - y[i]);
+    }
+    CHECK_EQ(star_net({ids.data(), x.data(), y.data(), size}), expected_star);
+  }
+}
+
+// Shortest rectilinear spanning tree of the points
+static uint64_t rmst(const std::vector<std::pair<uint32_t, uint32_t>> &points) {
+  std::vector<uint64_t> dist(points.size(), UINT64_MAX);
+  std::vector<bool> done(points.size(), false);
+  dist[0] = 0;
+  uint64_t length = 0;
+  for (size_t step = 0; step < points.size(); step++) {
+    size_t next = 0;
+    uint64_t best = UINT64_MAX;
+    for (size_t i = 0; i < points.size(); i++) {
+      if (!done[i] && dist[i] < best) {
+        best = dist[i];
+        next = i;
+      }
+    }
+    done[next] = true;
+    length += best;
+    for (size_t i = 0; i < points.size(); i++) {
+      uint64_t d =
+          std::max(points[i].first, points[next].first) -
+          std::min(points[i].first, points[next].first) +
+          std::max(points[i].second, points[next].second) -
+          std::min(points[i].second, points[next].second);
+      dist[i] = std::min(dist[i], d);
+    }
+  }
+  return length;
+}
+
+// Exact Steiner tree length: some tree is the spanning tree of the pins and
+// at most size - 2 points of the Hanan grid
+static uint64_t
+steiner_brute_force(std::vector<std::pair<uint32_t, uint32_t>> &points,
+                    const std::vector<std::pair<uint32_t, uint32_t>> &hanan,
+                    size_t first, size_t left) {
+  uint64_t best = rmst(points);
+  if (left == 0) {
+    return best;
+  }
+  for (size_t i = first; i < hanan.size(); i++) {
+    points.push_back(hanan[i]);
+    best = std::min(best, steiner_brute_force(points, hanan, i + 1, left - 1));
+    points.pop_back();
+  }
+  return best;
+}
+
+TEST_CASE("Steiner tree estimate") {
+  std::vector<uint64_t> ids(40, 0);
+  std::vector<uint32_t> x(40);
+  std::vector<uint32_t> y(40);
+
+  SUBCASE("Cross") {
+    // Four pins around a center are connected through it
+    x = {0, 2, 1, 1};
+    y = {1, 1, 0, 2};
+    CHECK_EQ(rsmt_net({ids.data(), x.data(), y.data(), 4}), 4);
+  }
+
+  SUBCASE("Small nets are exact") {
+    std::mt19937_64 rng(11);
+    for (size_t size = 2; size <= 6; size++) {
+      for (int net = 0; net < 20; net++) {
+        std::vector<std::pair<uint32_t, uint32_t>> points;
+        for (size_t i = 0; i < size; i++) {
+          // A small range, so some pins share a coordinate
+          x[i] = rng() % 12;
+          y[i] = rng() % 12;
+          points.emplace_back(x[i], y[i]);
+        }
+        std::vector<std::pair<uint32_t, uint32_t>> hanan;
+        for (size_t i = 0; i < size; i++) {
+          for (size_t j = 0; j < size; j++) {
+            hanan.emplace_back(x[i], y[j]);
+          }
+        }
+        CAPTURE(size);
+        CHECK_EQ(rsmt_net({ids.data(), x.data(), y.data(), size}),
+                 steiner_brute_force(points, hanan, 0, size - 2));
+      }
+    }
+  }
+
+  SUBCASE("Large nets") {
+    std::mt19937_64 rng(13);
+    for (size_t size = 7; size <= 40; size++) {
+      std::vector<std::pair<uint32_t, uint32_t>> points;
+      for (size_t i = 0; i < size; i++) {
+        x[i] = rng() % 1000;
+        y[i] = rng() % 1000;
+        points.emplace_back(x[i], y[i]);
+      }
+      pin_span pins = {ids.data(), x.data(), y.data(), size};
+      // A real tree, so never shorter than the half perimeter
+      CHECK_GE(rsmt_net(pins), hpwl_net(pins));
+      CHECK_LE(rsmt_net(pins), star_net(pins));
+    }
+  }
+}
+
+TEST_CASE("Incremental cost with random moves") {
+  Data data(200, 200);
+  for (uint64_t i = 0; i < 6; i++) {
+    data.add_net({i});
+  }
+  std::mt19937_64 rng(3);
+  for (uint64_t id = 0; id < 40; id++) {
+    std::vector<uint64_t> net_ids = {id % 6, (id * 7 + 1) % 6};
+    data.add_block({id, 0, 0, 1 + static_cast<uint32_t>(rng() % 3),
+                    1 + static_cast<uint32_t>(rng() % 3), net_ids});
+  }
+  REQUIRE(data.find_initial_placement());
+  hpwl_cost hpwl_model;
+  mcl_cost mcl_model;
+  star_cost star_model;
+  rsmt_cost rsmt_model;
+  uint64_t (*full_cost)(Data &) = hpwl;
+  SUBCASE("hpwl") {
+    CHECK_EQ(data.init_cost(hpwl_model), hpwl(data));
+  }
+  SUBCASE("mcl") {
+    full_cost = mcl;
+    CHECK_EQ(data.init_cost(mcl_model), full_cost(data));
+  }
+  SUBCASE("star") {
+    full_cost = star;
+    CHECK_EQ(data.init_cost(star_model), full_cost(data));
+  }
+  SUBCASE("rsmt") {
+    full_cost = rsmt;
+    CHECK_EQ(data.init_cost(rsmt_model), full_cost(data));
+  }
+
+  random_transactions(data, rng, 200, [&](bool) {
+    REQUIRE_EQ(data.update_cost(), full_cost(data));
+  });
+}
+
+// Follows random transactions with one RUDY model. After each of them a fresh
+// model has to agree, then the two swap. Returns the initial cost
+template <class Wirelength>
+static uint64_t follow_rudy(Data &data, std::mt19937_64 &rng, int steps) {
+  rudy_cost<Wirelength> first(data.chip_x, data.chip_y, 3, 8);
+  rudy_cost<Wirelength> second(data.chip_x, data.chip_y, 3, 8);
+  rudy_cost<Wirelength> *current = &first;
+  rudy_cost<Wirelength> *fresh = &second;
+  uint64_t initial = data.init_cost(*current);
+  random_transactions(data, rng, steps, [&](bool open) {
+    uint64_t cost = data.update_cost(*current);
+    if (!open) {
+      REQUIRE_EQ(data.init_cost(*fresh), cost);
+      std::swap(current, fresh);
+    }
+  });
+  return initial;
+}
+
+// Cost of a whole net, as the incremental model has to report it
+static uint64_t full_net(const hpwl_cost &, const pin_span &pins) {
+  return hpwl_net(pins);
+}
+static uint64_t full_net(const mcl_cost &, const pin_span &pins) {
+  return mcl_net(pins);
+}
+static uint64_t full_net(const star_cost &, const pin_span &pins) {
+  return star_net(pins);
+}
+
+TYPE_TO_STRING(hpwl_cost);
+TYPE_TO_STRING(mcl_cost);
+TYPE_TO_STRING(star_cost);
+
+// Skipped and weighted nets change which nets reach the model, so every model
+// with state per net is checked
+TEST_CASE_TEMPLATE("Large nets", Cost, hpwl_cost, mcl_cost, star_cost) {
+  Data data(200, 200);
+  for (uint64_t i = 0; i < 4; i++) {
+    data.add_net({i});
+  }
+  std::mt19937_64 rng(9);
+  // Net 0 is on every block, the others on a few
+  for (uint64_t id = 0; id < 30; id++) {
+    std::vector<uint64_t> net_ids = {0};
+    if (id % 5 == 0) {
+      net_ids.push_back(1 + id % 3);
+    }
+    data.add_block({id, 0, 0, 1 + static_cast<uint32_t>(rng() % 3),
+                    1 + static_cast<uint32_t>(rng() % 3), net_ids});
+  }
+  REQUIRE(data.find_initial_placement());
+  Cost model;
+  // Cost of the nets 1 to 3 plus weight percent of net 0
+  auto expected = [&](uint64_t weight) {
+    uint64_t cost = full_net(model, data.get_pins(0)) * weight / 100;
+    for (size_t i = 1; i < data.num_nets; i++) {
+      cost += full_net(model, data.get_pins(i));
+    }
+    return cost;
+  };
+  uint64_t weight = 100;
+  bool rudy = false;
+  SUBCASE("Keep") {
+    CHECK_EQ(data.set_large_nets(10, LARGE_NETS_KEEP, 10), 1);
+  }
+  SUBCASE("Skip") {
+    CHECK_EQ(data.set_large_nets(10, LARGE_NETS_SKIP, 10), 1);
+    weight = 0;
+  }
+  // Skipped nets must not leave demand behind in the bins
+  SUBCASE("Skip+rudy") {
+    CHECK_EQ(data.set_large_nets(10, LARGE_NETS_SKIP, 10), 1);
+    weight = 0;
+    rudy = true;
+  }
+  SUBCASE("Weight") {
+    CHECK_EQ(data.set_large_nets(10, LARGE_NETS_WEIGHT, 10), 1);
+    weight = 10;
+  }
+  if (rudy) {
+    uint64_t wirelength = expected(weight);
+    CHECK_GT(follow_rudy<Cost>(data, rng, 100), wirelength);
+    return;
+  }
+  CHECK_EQ(data.init_cost(model), expected(weight));
+  random_transactions(data, rng, 100, [&](bool) {
+    REQUIRE_EQ(data.update_cost(), expected(weight));
+  });
+}
+
+TEST_CASE("RUDY congestion") {
+  Data data(200, 200);
+  for (uint64_t i = 0; i < 6; i++) {
+    data.add_net({i});
+  }
+  std::mt19937_64 rng(5);
+  for (uint64_t id = 0; id < 40; id++) {
+    std::vector<uint64_t> net_ids = {id % 6, (id * 7 + 1) % 6};
+    data.add_block({id, 0, 0, 1 + static_cast<uint32_t>(rng() % 3),
+                    1 + static_cast<uint32_t>(rng() % 3), net_ids});
+  }
+  REQUIRE(data.find_initial_placement());
+  uint64_t wirelength = hpwl(data);
+  CHECK_GT(follow_rudy<hpwl_cost>(data, rng, 200), wirelength);
+}
+
+TEST_CASE("Per move annealing") {
+  Data data(60, 60);
+  annealing_netlist(data, 6, 30);
+  hpwl_cost model;
+  uint64_t initial_cost = data.init_cost(model);
+
+  Xoshiro256pp rng(1);
+  uint64_t best = anneal(data, model, rng, 1'000'000, 0, 10, 1, 10, 1, 2000, 0,
+                         100, 10, 1, true, false, quiet_log);
+  CHECK_LE(best, initial_cost);
+  CHECK_LE(best, data.get_cost());
+  CHECK_EQ(data.get_cost(), hpwl(data));
+}
+
+TEST_CASE("Parallel tempering") {
+  Data data(60, 60);
+  annealing_netlist(data, 6, 30);
+  hpwl_cost model;
+  uint64_t initial_cost = data.init_cost(model);
+
+  Xoshiro256pp rng(2);
+  uint64_t best = anneal_tempering(data, model, rng, 3, 50, 1'000'000, 1000,
+                                   10, 1, 10, 1, 500, 0, 50, 10, 1, false,
+                                   false, quiet_log);
+  CHECK_LE(best, initial_cost);
+  CHECK_EQ(best, data.get_cost());
+  CHECK_EQ(data.get_cost(), hpwl(data));
+  for (size_t i = 0; i < data.num_blocks; i++) {
+    CHECK(data.legal(data.get_block_by_index(i)));
+  }
+}
+
+TEST_CASE("Islands") {
+  Data data(60, 60);
+  annealing_netlist(data, 6, 30);
+  hpwl_cost model;
+  uint64_t initial_cost = data.init_cost(model);
+
+  Xoshiro256pp rng(4);
+  Data copy = data;
+  hpwl_cost copy_model;
+  copy.init_cost(copy_model);
+  Xoshiro256pp copy_rng = rng;
+  uint64_t best = anneal_islands(data, model, rng, 3, 40, 1'000'000, 1000, 10,
+                                 1, 10, 1, 500, 0, 50, 10, 1, false, false,
+                                 quiet_log);
+  CHECK_LE(best, initial_cost);
+  CHECK_EQ(best, data.get_cost());
+  CHECK_EQ(data.get_cost(), hpwl(data));
+  for (size_t i = 0; i < data.num_blocks; i++) {
+    CHECK(data.legal(data.get_block_by_index(i)));
+  }
+  // Same seed, same result
+  CHECK_EQ(anneal_islands(copy, copy_model, copy_rng, 3, 40, 1'000'000, 1000,
+                          10, 1, 10, 1, 500, 0, 50, 10, 1, false, false,
+                          quiet_log),
+           best);
+}
+
+TEST_CASE("Speculative moves") {
+  Data data(60, 60);
+  annealing_netlist(data, 12, 60);
+
+  // The moves are decided in the main thread, so the number of threads
+  // doesn't change the result
+  std::vector<uint64_t> costs;
+  std::vector<std::vector<block>> placements;
+  for (uint32_t threads : {1, 3}) {
+    Data copy = data;
+    hpwl_cost model;
+    uint64_t initial_cost = copy.init_cost(model);
+    Xoshiro256pp rng(6);
+    uint64_t best = anneal_speculative(copy, model, rng, threads, 16,
+                                       1'000'000, 1000, 10, 1, 10, 1, 2000, 0,
+                                       50, 10, 1, false, quiet_log);
+    CHECK_LE(best, initial_cost);
+    CHECK_EQ(copy.get_cost(), hpwl(copy));
+    for (size_t i = 0; i < copy.num_blocks; i++) {
+      CHECK(copy.legal(copy.get_block_by_index(i)));
+    }
+    costs.push_back(best);
+    placements.push_back(copy.get_best_blocks());
+  }
+  CHECK_EQ(costs[0], costs[1]);
+  for (size_t i = 0; i < data.num_blocks; i++) {
+    CHECK_EQ(placements[0][i].x, placements[1][i].x);
+    CHECK_EQ(placements[0][i].y, placements[1][i].y);
+  }
+
+  // A batch size too small to share is raised, so the copies also have to
+  // follow the moves accepted one after the other
+  hpwl_cost model;
+  data.init_cost(model);
+  Xoshiro256pp rng(7);
+  anneal_speculative(data, model, rng, 2, 1, 1'000'000, 1000, 10, 1, 10, 1,
+                     2000, 0, 50, 10, 1, false, quiet_log);
+  CHECK_EQ(data.get_cost(), hpwl(data));
+  for (size_t i = 0; i < data.num_blocks; i++) {
+    CHECK(data.legal(data.get_block_by_index(i)));
+  }
+}
+
+TEST_CASE("Parallel full cost") {
+  Data data(1000, 1000);
+  for (uint64_t i = 0; i < 2000; i++) {
+    data.add_net({i});
+  }
+  std::mt19937_64 rng(11);
+  for (uint64_t id = 0; id < 10000; id++) {
+    // A few large nets and many small ones
+    std::vector<uint64_t> net_ids = {rng() % 8, rng() % 2000, rng() % 2000,
+                                     rng() % 2000};
+    data.add_block({id, static_cast<uint32_t>(rng() % 990),
+                    static_cast<uint32_t>(rng() % 990), 1, 1, net_ids});
+  }
+
+  set_cost_threads(1);
+  uint64_t serial_hpwl = hpwl(data);
+  uint64_t serial_mcl = mcl(data);
+  uint64_t serial_star = star(data);
+  set_cost_threads(4);
+  CHECK_EQ(hpwl(data), serial_hpwl);
+  CHECK_EQ(mcl(data), serial_mcl);
+  CHECK_EQ(star(data), serial_star);
+  set_cost_threads(std::thread::hardware_concurrency());
+}
@@ -0,0 +1,37 @@
+#include "../include/arena.h"
+#include "doctest.h"
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// Arena Tests
+TEST_CASE("Test Arena") {
+  Arena arena;
+  CHECK_EQ(arena.used(), 0);
+  CHECK_EQ(arena.reserved(), 0);
+
+  std::pmr::vector<uint64_t> small(&arena);
+  for (uint64_t i = 0; i < 1000; i++) {
+    small.push_back(i);
+  }
+  CHECK_EQ(reinterpret_cast<uintptr_t>(small.data()) % alignof(uint64_t), 0);
+  CHECK_GE(arena.used(), 1000 * sizeof(uint64_t));
+  CHECK_LE(arena.used(), arena.reserved());
+
+  SUBCASE("Allocation larger than a chunk") {
+    std::pmr::vector<char> large(3 * ARENA_MAX_CHUNK / 2, 1, &arena);
+    CHECK_EQ(large.front(), 1);
+    CHECK_EQ(large.back(), 1);
+    // The other allocations are not touched
+    for (uint64_t i = 0; i < 1000; i++) {
+      CHECK_EQ(small[i], i);
+    }
+  }
+
+  SUBCASE("Alignment") {
+    void *p = arena.allocate(1, 1);
+    void *q = arena.allocate(64, 64);
+    CHECK_NE(p, q);
+    CHECK_EQ(reinterpret_cast<uintptr_t>(q) % 64, 0);
+  }
+}
@@ -1,6 +1,9 @@
 #include "../include/data.h"
 #include "doctest.h"
+#include "random_transactions.h"
+#include <algorithm>
 #include <cstdint>
+#include <random>
 
 // Data Tests
 // NOTE: Because the 1 unit distance to the edge requirement was added later,
@@ -12,9 +15,9 @@
 // Test Add Net and Block
 TEST_CASE("Add Net and Block") {
   Data data(20, 20);
-  data.add_net({0, {}});
-  data.add_net({2, {}});
-  data.add_net({3, {}});
+  data.add_net({0});
+  data.add_net({2});
+  data.add_net({3});
   REQUIRE_EQ(data.num_nets, 3);
 
   data.add_block({10, 0, 0, 2, 3, {0, 3}});
@@ -30,14 +33,14 @@ TEST_CASE("Add Net and Block") {
     {
       net &n = data.get_net_by_id(0);
       {
-        std::tie(id, x, y) = n.pins[0];
+        std::tie(id, x, y) = data.get_pins(n)[0];
         block &b = data.get_block_by_id(10);
         CHECK_EQ(id, 10);
         CHECK_EQ(x, b.x);
         CHECK_EQ(y, b.y);
       }
       {
-        std::tie(id, x, y) = n.pins[1];
+        std::tie(id, x, y) = data.get_pins(n)[1];
         block &b = data.get_block_by_id(11);
         CHECK_EQ(id, 11);
         CHECK_EQ(x, b.x);
@@ -45,7 +48,7 @@ TEST_CASE("Add Net and Block") {
       }
 
       {
-        std::tie(id, x, y) = n.pins[2];
+        std::tie(id, x, y) = data.get_pins(n)[2];
         block &b = data.get_block_by_id(12);
         CHECK_EQ(id, 12);
         CHECK_EQ(x, b.x);
@@ -55,14 +58,14 @@ TEST_CASE("Add Net and Block") {
     {
       net &n = data.get_net_by_id(2);
       {
-        std::tie(id, x, y) = n.pins[0];
+        std::tie(id, x, y) = data.get_pins(n)[0];
         block &b = data.get_block_by_id(12);
         CHECK_EQ(id, 12);
         CHECK_EQ(x, b.x);
         CHECK_EQ(y, b.y);
       }
       {
-        std::tie(id, x, y) = n.pins[1];
+        std::tie(id, x, y) = data.get_pins(n)[1];
         block &b = data.get_block_by_id(13);
         CHECK_EQ(id, 13);
         CHECK_EQ(x, b.x);
@@ -73,14 +76,14 @@ TEST_CASE("Add Net and Block") {
     {
       net &n = data.get_net_by_id(3);
       {
-        std::tie(id, x, y) = n.pins[0];
+        std::tie(id, x, y) = data.get_pins(n)[0];
         block &b = data.get_block_by_id(10);
         CHECK_EQ(id, 10);
         CHECK_EQ(x, b.x);
         CHECK_EQ(y, b.y);
       }
       {
-        std::tie(id, x, y) = n.pins[1];
+        std::tie(id, x, y) = data.get_pins(n)[1];
         block &b = data.get_block_by_id(13);
         CHECK_EQ(id, 13);
         CHECK_EQ(x, b.x);
@@ -220,9 +223,9 @@ TEST_CASE("Test overlap()") {
 TEST_CASE("Test legal()") {
   Data data(20, 20);
 
-  data.add_net({0, {}});
-  data.add_net({2, {}});
-  data.add_net({3, {}});
+  data.add_net({0});
+  data.add_net({2});
+  data.add_net({3});
   REQUIRE_EQ(data.num_nets, 3);
 
   data.add_block({10, 0, 0, 2, 3, {0, 3}});
@@ -312,9 +315,9 @@ TEST_CASE("Test legal()") {
 // Test get_index_from_pos
 TEST_CASE("Test get_index_from_pos") {
   Data data(20, 20);
-  data.add_net({0, {}});
-  data.add_net({2, {}});
-  data.add_net({3, {}});
+  data.add_net({0});
+  data.add_net({2});
+  data.add_net({3});
   REQUIRE_EQ(data.num_nets, 3);
 
   data.add_block({10, 0, 0, 2, 3, {0, 3}});
@@ -332,9 +335,9 @@ TEST_CASE("Test get_index_from_pos") {
 // Test try_shift
 TEST_CASE("Test try_shift()") {
   Data data(20, 20);
-  data.add_net({0, {}});
-  data.add_net({2, {}});
-  data.add_net({3, {}});
+  data.add_net({0});
+  data.add_net({2});
+  data.add_net({3});
   REQUIRE_EQ(data.num_nets, 3);
 
   data.add_block({10, 0, 0, 2, 3, {0, 3}});
@@ -349,21 +352,21 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 15);
         CHECK_EQ(y, 16);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 4);
         CHECK_EQ(y, 2);
@@ -373,14 +376,14 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 15);
         CHECK_EQ(y, 16);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -394,14 +397,14 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 2") {
       net &n = data.get_net_by_id(2);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 4);
         CHECK_EQ(y, 2);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 7);
@@ -411,14 +414,14 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 0);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 7);
@@ -432,21 +435,21 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 0);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 4);
         CHECK_EQ(y, 2);
@@ -456,14 +459,14 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 0);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -477,21 +480,21 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 0);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 4);
         CHECK_EQ(y, 2);
@@ -501,14 +504,14 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 0);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -522,21 +525,21 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 0);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 4);
         CHECK_EQ(y, 2);
@@ -546,14 +549,14 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 0);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -567,21 +570,21 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 0);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 4);
         CHECK_EQ(y, 2);
@@ -591,14 +594,14 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 0);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -612,21 +615,21 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 0);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 4);
         CHECK_EQ(y, 2);
@@ -636,14 +639,14 @@ TEST_CASE("Test try_shift()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 0);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -655,9 +658,9 @@ TEST_CASE("Test try_shift()") {
 // Test try_swap
 TEST_CASE("Test try_swap") {
   Data data(20, 20);
-  data.add_net({0, {}});
-  data.add_net({2, {}});
-  data.add_net({3, {}});
+  data.add_net({0});
+  data.add_net({2});
+  data.add_net({3});
   REQUIRE_EQ(data.num_nets, 3);
 
   data.add_block({10, 1, 1, 2, 3, {0, 3}});
@@ -678,21 +681,21 @@ TEST_CASE("Test try_swap") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 0);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 4);
         CHECK_EQ(y, 2);
@@ -702,14 +705,14 @@ TEST_CASE("Test try_swap") {
     SUBCASE("Check pins on net 2") {
       net &n = data.get_net_by_id(2);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 4);
         CHECK_EQ(y, 2);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 1);
@@ -719,14 +722,14 @@ TEST_CASE("Test try_swap") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 1);
@@ -738,9 +741,9 @@ TEST_CASE("Test try_swap") {
 // Test try_rot_cw
 TEST_CASE("Test try_rot_cw()") {
   Data data(20, 20);
-  data.add_net({0, {}});
-  data.add_net({2, {}});
-  data.add_net({3, {}});
+  data.add_net({0});
+  data.add_net({2});
+  data.add_net({3});
   REQUIRE_EQ(data.num_nets, 3);
 
   data.add_block({10, 1, 1, 2, 3, {0, 3}});
@@ -756,21 +759,21 @@ TEST_CASE("Test try_rot_cw()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 3);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 6);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 2);
@@ -780,14 +783,14 @@ TEST_CASE("Test try_rot_cw()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 3);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -801,21 +804,21 @@ TEST_CASE("Test try_rot_cw()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 3);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 6);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 2);
@@ -825,14 +828,14 @@ TEST_CASE("Test try_rot_cw()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 3);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -846,21 +849,21 @@ TEST_CASE("Test try_rot_cw()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 2);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 6);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 2);
@@ -870,14 +873,14 @@ TEST_CASE("Test try_rot_cw()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 2);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -891,21 +894,21 @@ TEST_CASE("Test try_rot_cw()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 6);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 2);
@@ -915,14 +918,14 @@ TEST_CASE("Test try_rot_cw()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -934,9 +937,9 @@ TEST_CASE("Test try_rot_cw()") {
 // Test try_rot_cc
 TEST_CASE("Test try_rot_cc()") {
   Data data(20, 20);
-  data.add_net({0, {}});
-  data.add_net({2, {}});
-  data.add_net({3, {}});
+  data.add_net({0});
+  data.add_net({2});
+  data.add_net({3});
   REQUIRE_EQ(data.num_nets, 3);
 
   data.add_block({10, 1, 1, 2, 3, {0, 3}});
@@ -952,21 +955,21 @@ TEST_CASE("Test try_rot_cc()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 2);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 6);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 2);
@@ -976,14 +979,14 @@ TEST_CASE("Test try_rot_cc()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 2);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -997,21 +1000,21 @@ TEST_CASE("Test try_rot_cc()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 3);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 6);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 2);
@@ -1021,14 +1024,14 @@ TEST_CASE("Test try_rot_cc()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 3);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -1042,21 +1045,21 @@ TEST_CASE("Test try_rot_cc()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 3);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 6);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 2);
@@ -1066,14 +1069,14 @@ TEST_CASE("Test try_rot_cc()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 3);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -1087,21 +1090,21 @@ TEST_CASE("Test try_rot_cc()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 6);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 2);
@@ -1111,14 +1114,14 @@ TEST_CASE("Test try_rot_cc()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -1130,9 +1133,9 @@ TEST_CASE("Test try_rot_cc()") {
 // Test try_flip_h
 TEST_CASE("Test try_flip_h()") {
   Data data(20, 20);
-  data.add_net({0, {}});
-  data.add_net({2, {}});
-  data.add_net({3, {}});
+  data.add_net({0});
+  data.add_net({2});
+  data.add_net({3});
   REQUIRE_EQ(data.num_nets, 3);
 
   data.add_block({10, 1, 1, 2, 3, {0, 3}});
@@ -1148,21 +1151,21 @@ TEST_CASE("Test try_flip_h()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 6);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 2);
@@ -1172,14 +1175,14 @@ TEST_CASE("Test try_flip_h()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -1193,21 +1196,21 @@ TEST_CASE("Test try_flip_h()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 6);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 2);
@@ -1217,14 +1220,14 @@ TEST_CASE("Test try_flip_h()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -1236,9 +1239,9 @@ TEST_CASE("Test try_flip_h()") {
 // Test try_flip_v
 TEST_CASE("Test try_flip_v()") {
   Data data(20, 20);
-  data.add_net({0, {}});
-  data.add_net({2, {}});
-  data.add_net({3, {}});
+  data.add_net({0});
+  data.add_net({2});
+  data.add_net({3});
   REQUIRE_EQ(data.num_nets, 3);
 
   data.add_block({10, 1, 1, 2, 3, {0, 3}});
@@ -1254,21 +1257,21 @@ TEST_CASE("Test try_flip_v()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 3);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 6);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 2);
@@ -1278,14 +1281,14 @@ TEST_CASE("Test try_flip_v()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 3);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -1299,21 +1302,21 @@ TEST_CASE("Test try_flip_v()") {
     SUBCASE("Check pins on net 0") {
       net &n = data.get_net_by_id(0);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 11);
         CHECK_EQ(x, 2);
         CHECK_EQ(y, 6);
       }
 
       {
-        auto [id, x, y] = n.pins[2];
+        auto [id, x, y] = data.get_pins(n)[2];
         CHECK_EQ(id, 12);
         CHECK_EQ(x, 5);
         CHECK_EQ(y, 2);
@@ -1323,14 +1326,14 @@ TEST_CASE("Test try_flip_v()") {
     SUBCASE("Check pins on net 3") {
       net &n = data.get_net_by_id(3);
       {
-        auto [id, x, y] = n.pins[0];
+        auto [id, x, y] = data.get_pins(n)[0];
         CHECK_EQ(id, 10);
         CHECK_EQ(x, 1);
         CHECK_EQ(y, 1);
       }
 
       {
-        auto [id, x, y] = n.pins[1];
+        auto [id, x, y] = data.get_pins(n)[1];
         CHECK_EQ(id, 13);
         CHECK_EQ(x, 9);
         CHECK_EQ(y, 9);
@@ -1338,3 +1341,376 @@ TEST_CASE("Test try_flip_v()") {
     }
   }
 }
+
+TEST_CASE("Test rollback()") {
+  Data data(20, 20);
+  data.add_net({0});
+  data.add_net({2});
+  data.add_net({3});
+  REQUIRE_EQ(data.num_nets, 3);
+
+  data.add_block({10, 1, 1, 2, 3, {0, 3}});
+  data.add_block({11, 5, 1, 2, 2, {0}});
+  data.add_block({12, 4, 5, 1, 1, {0, 2}});
+  data.add_block({13, 9, 9, 2, 3, {2, 3}});
+  REQUIRE_EQ(data.num_blocks, 4);
+
+  std::vector<block> blocks;
+  std::vector<std::tuple<uint64_t, uint32_t, uint32_t>> pins;
+  for (size_t i = 0; i < data.num_blocks; i++) {
+    blocks.push_back(data.get_block_by_index(i));
+  }
+  for (size_t i = 0; i < data.num_nets; i++) {
+    for (size_t j = 0; j < data.get_pins(i).size; j++) {
+      pins.push_back(data.get_pins(i)[j]);
+    }
+  }
+
+  data.begin_transaction();
+  CHECK(data.try_shift(data.get_block_by_id(10), 10, 1));
+  CHECK(data.try_swap(data.get_block_by_id(11), data.get_block_by_id(13)));
+  CHECK(data.try_rot_cw(data.get_block_by_id(12)));
+  CHECK(data.try_flip_h(data.get_block_by_id(10)));
+  CHECK(data.try_shift(data.get_block_by_id(10), 0, 2));
+  CHECK(data.try_rot_cc(data.get_block_by_id(13)));
+  CHECK_FALSE(data.try_shift(data.get_block_by_id(13), -30, 0));
+
+  SUBCASE("Rollback restores everything") {
+    data.rollback();
+    for (size_t i = 0; i < data.num_blocks; i++) {
+      block &b = data.get_block_by_index(i);
+      CHECK_EQ(b.x, blocks[i].x);
+      CHECK_EQ(b.y, blocks[i].y);
+      CHECK_EQ(b.len_x, blocks[i].len_x);
+      CHECK_EQ(b.len_y, blocks[i].len_y);
+      CHECK_EQ(b.corner, blocks[i].corner);
+    }
+    size_t k = 0;
+    for (size_t i = 0; i < data.num_nets; i++) {
+      for (size_t j = 0; j < data.get_pins(i).size; j++) {
+        CHECK(data.get_pins(i)[j] == pins[k++]);
+      }
+    }
+  }
+
+  SUBCASE("Commit keeps moves") {
+    data.commit();
+    data.rollback();
+    block &b = data.get_block_by_id(10);
+    CHECK_EQ(b.x, 11);
+    CHECK_EQ(b.y, 4);
+  }
+}
+
+TEST_CASE("Test bins agree with full scan") {
+  Data data(60, 60);
+  data.add_net({0});
+  for (uint64_t id = 0; id < 40; id++) {
+    data.add_block({id, 0, 0, 1 + static_cast<uint32_t>(id % 4),
+                    1 + static_cast<uint32_t>(id % 3), {0}});
+  }
+  REQUIRE(data.find_initial_placement());
+
+  // Brute force legality check as legal() did before the bins
+  auto scan = [&data](block &a) {
+    for (size_t i = 0; i < data.num_blocks; i++) {
+      block &b = data.get_block_by_index(i);
+      if (a.id != b.id && data.overlap(a, b)) {
+        return false;
+      }
+    }
+    return true;
+  };
+
+  std::mt19937 rng(42);
+  random_transactions(data, rng, 200, [&](bool open) {
+    if (open) {
+      return;
+    }
+    for (size_t i = 0; i < data.num_blocks; i++) {
+      block &b = data.get_block_by_index(i);
+      REQUIRE(data.legal(b));
+      // Probe a shifted copy, which may overlap its neighbours
+      block probe = {UINT64_MAX, b.x + 1, b.y + 1, b.len_x, b.len_y, {}};
+      CHECK_EQ(data.legal(probe), probe.x + probe.len_x < data.chip_x &&
+                                      probe.y + probe.len_y < data.chip_y &&
+                                      scan(probe));
+    }
+  });
+}
+
+TEST_CASE("Test moves with pin slot index") {
+  // Net 0 is a high-fanout net connected to every block, nets 1 and 2 get an
+  // input or output pin in front of the block pins
+  Data data(80, 80);
+  data.add_net({0});
+  data.add_net({1});
+  data.add_net({2});
+  data.add_input(1);
+  data.add_output(2);
+  for (uint64_t id = 100; id < 130; id++) {
+    std::vector<uint64_t> net_ids = {0};
+    net_ids.push_back(id % 2 + 1);
+    data.add_block({id, 0, 0, 2 + static_cast<uint32_t>(id % 3),
+                    2 + static_cast<uint32_t>(id % 2), net_ids});
+  }
+  REQUIRE(data.create_pins());
+  REQUIRE(data.find_initial_placement());
+
+  // Reference model: all pins of a block sit on the same corner, which moves
+  // with flips and rotations
+  struct corner {
+    bool right;
+    bool bottom;
+  };
+  std::vector<corner> corners(data.num_blocks, {false, false});
+  auto index_of = [&data](uint64_t id) {
+    return data.get_index_from_pos(data.get_block_by_id(id).x,
+                                   data.get_block_by_id(id).y);
+  };
+
+  std::mt19937 rng(7);
+  for (int step = 0; step < 500; step++) {
+    size_t i = rng() % data.num_blocks;
+    block &b = data.get_block_by_index(i);
+    switch (rng() % 6) {
+    case 0:
+      data.try_shift(b, static_cast<int32_t>(rng() % 11) - 5,
+                     static_cast<int32_t>(rng() % 11) - 5);
+      break;
+    case 1: {
+      size_t j = rng() % data.num_blocks;
+      if (data.try_swap(b, data.get_block_by_index(j))) {
+        REQUIRE_EQ(index_of(data.get_block_by_index(j).id), j);
+      }
+      break;
+    }
+    case 2:
+      if (data.try_flip_h(b)) {
+        corners[i].right = !corners[i].right;
+      }
+      break;
+    case 3:
+      if (data.try_flip_v(b)) {
+        corners[i].bottom = !corners[i].bottom;
+      }
+      break;
+    case 4:
+      if (data.try_rot_cw(b)) {
+        corners[i] = {!corners[i].bottom, corners[i].right};
+      }
+      break;
+    default:
+      if (data.try_rot_cc(b)) {
+        corners[i] = {corners[i].bottom, !corners[i].right};
+      }
+    }
+
+    // Check every pin of every net, found the way the moves used to search
+    // for them
+    size_t pins_found = 0;
+    for (size_t n = 0; n < data.num_nets; n++) {
+      pin_span pins = data.get_pins(n);
+      for (size_t j = 0; j < pins.size; j++) {
+        auto [id, x, y] = pins[j];
+        if (id == UINT64_MAX) {
+          CHECK((x == 0 || x == data.chip_x - 1));
+          continue;
+        }
+        size_t k = index_of(id);
+        block &owner = data.get_block_by_index(k);
+        REQUIRE_EQ(x, owner.x + (corners[k].right ? owner.len_x - 1 : 0));
+        REQUIRE_EQ(y, owner.y + (corners[k].bottom ? owner.len_y - 1 : 0));
+        pins_found++;
+      }
+    }
+    REQUIRE_EQ(pins_found, 2 * data.num_blocks);
+  }
+}
+
+TEST_CASE("Test sparse ids") {
+  Data data(40, 40);
+  data.add_net({1'000'000});
+  data.add_net({7});
+  data.add_net({UINT64_MAX - 1});
+
+  data.add_block({5'000'000'000, 0, 0, 2, 3, {7, 1'000'000}});
+  data.add_block({3, 0, 0, 4, 4, {UINT64_MAX - 1}});
+  data.add_block({1ull << 40, 0, 0, 1, 1, {7, UINT64_MAX - 1}});
+
+  CHECK_EQ(data.get_net_by_id(1'000'000).id, 1'000'000);
+  CHECK_EQ(data.get_net_by_id(7).id, 7);
+  CHECK_EQ(data.get_net_by_id(UINT64_MAX - 1).id, UINT64_MAX - 1);
+  CHECK_EQ(data.get_pins(data.get_net_by_id(7)).size, 2);
+
+  // Placement sorts the blocks, so the tables have to follow
+  REQUIRE(data.find_initial_placement());
+  CHECK_EQ(data.get_block_by_index(0).id, 3);
+  for (uint64_t id : {5'000'000'000ull, 3ull, 1ull << 40}) {
+    block &b = data.get_block_by_id(id);
+    CHECK_EQ(b.id, id);
+    CHECK(data.try_shift(b, 0, 10));
+  }
+  for (size_t i = 0; i < data.num_nets; i++) {
+    pin_span pins = data.get_pins(i);
+    for (size_t j = 0; j < pins.size; j++) {
+      auto [id, x, y] = pins[j];
+      block &b = data.get_block_by_id(id);
+      CHECK_EQ(x, b.x);
+      CHECK_EQ(y, b.y);
+    }
+  }
+}
+
+TEST_CASE("Test save_best()") {
+  Data data(40, 40);
+  data.add_net({0});
+  data.add_net({1});
+  data.add_input(0);
+  data.add_output(1);
+  for (uint64_t id = 0; id < 12; id++) {
+    data.add_block({id, 0, 0, 2 + static_cast<uint32_t>(id % 2), 3, {0, 1}});
+  }
+  REQUIRE(data.create_pins());
+  REQUIRE(data.find_initial_placement());
+
+  std::vector<block> blocks;
+  std::vector<std::tuple<uint64_t, uint32_t, uint32_t>> pins;
+  auto snapshot = [&]() {
+    blocks.clear();
+    pins.clear();
+    for (size_t i = 0; i < data.num_blocks; i++) {
+      blocks.push_back(data.get_block_by_index(i));
+    }
+    for (size_t i = 0; i < data.num_nets; i++) {
+      for (size_t j = 0; j < data.get_pins(i).size; j++) {
+        pins.push_back(data.get_pins(i)[j]);
+      }
+    }
+  };
+  auto check_best = [&]() {
+    std::vector<block> best = data.get_best_blocks();
+    REQUIRE_EQ(best.size(), blocks.size());
+    for (size_t i = 0; i < best.size(); i++) {
+      CHECK_EQ(best[i].id, blocks[i].id);
+      CHECK_EQ(best[i].x, blocks[i].x);
+      CHECK_EQ(best[i].y, blocks[i].y);
+      CHECK_EQ(best[i].len_x, blocks[i].len_x);
+      CHECK_EQ(best[i].len_y, blocks[i].len_y);
+    }
+    size_t k = 0;
+    for (size_t i = 0; i < data.num_nets; i++) {
+      for (size_t j = 0; j < data.get_best_pins(i).size; j++) {
+        CHECK(data.get_best_pins(i)[j] == pins[k++]);
+      }
+    }
+  };
+
+  std::mt19937 rng(3);
+  auto random_moves = [&]() {
+    for (int i = 0; i < 10; i++) {
+      block &b = data.get_block_by_index(rng() % data.num_blocks);
+      switch (rng() % 5) {
+      case 0:
+        data.try_shift(b, static_cast<int32_t>(rng() % 9) - 4,
+                       static_cast<int32_t>(rng() % 9) - 4);
+        break;
+      case 1:
+        data.try_swap(b, data.get_block_by_index(rng() % data.num_blocks));
+        break;
+      case 2:
+        data.try_flip_h(b);
+        break;
+      case 3:
+        data.try_flip_v(b);
+        break;
+      default:
+        data.try_rot_cw(b);
+      }
+    }
+  };
+
+  data.save_best();
+  snapshot();
+  random_moves();
+  check_best();
+
+  // Only the moved blocks are copied from now on
+  for (int round = 0; round < 20; round++) {
+    random_moves();
+    data.save_best();
+    snapshot();
+    random_moves();
+    check_best();
+  }
+}
+
+// Distance between the leftmost and the rightmost pin
+static uint64_t x_span(const pin_span &pins) {
+  if (pins.size == 0) {
+    return 0;
+  }
+  uint32_t min = *std::min_element(pins.x, pins.x + pins.size);
+  uint32_t max = *std::max_element(pins.x, pins.x + pins.size);
+  return max - min;
+}
+
+TEST_CASE("Test copies share the netlist") {
+  Data data(40, 40);
+  data.add_net({0});
+  data.add_net({1});
+  for (uint64_t id = 0; id < 10; id++) {
+    data.add_block({id, 0, 0, 2, 2, {id % 2}});
+  }
+  REQUIRE(data.find_initial_placement());
+  data.init_cost(x_span);
+
+  Data copy(data);
+  copy.init_cost(x_span);
+  std::vector<block> before = data.get_best_blocks();
+  std::mt19937 rng(5);
+  for (int i = 0; i < 50; i++) {
+    copy.try_shift(copy.get_block_by_index(rng() % copy.num_blocks),
+                   static_cast<int32_t>(rng() % 9) - 4,
+                   static_cast<int32_t>(rng() % 9) - 4);
+  }
+  copy.update_cost();
+  copy.save_best();
+  CHECK_EQ(copy.get_pins(0).ids, data.get_pins(0).ids);
+
+  // The moves of the copy leave the original alone
+  for (size_t i = 0; i < data.num_blocks; i++) {
+    CHECK_EQ(data.get_block_by_index(i).x, before[i].x);
+    CHECK_EQ(data.get_block_by_index(i).y, before[i].y);
+  }
+  CHECK_EQ(data.update_cost(),
+           x_span(data.get_pins(0)) + x_span(data.get_pins(1)));
+
+  // Taking over the placement of the copy
+  data.set_placement(copy.get_best_blocks());
+  CHECK_EQ(data.update_cost(), copy.get_cost());
+  for (size_t i = 0; i < data.num_blocks; i++) {
+    CHECK(data.legal(data.get_block_by_index(i)));
+    CHECK_EQ(data.get_block_by_index(i).x, copy.get_block_by_index(i).x);
+    CHECK_EQ(data.get_block_by_index(i).y, copy.get_block_by_index(i).y);
+  }
+}
+
+TEST_CASE("Test degree buckets") {
+  Data data(50, 50);
+  for (uint64_t i = 0; i < 4; i++) {
+    data.add_net({i});
+  }
+  data.add_block({10, 0, 0, 1, 1, {0, 1, 2}});
+  data.add_block({11, 2, 0, 1, 1, {0, 1, 2}});
+  data.add_block({12, 4, 0, 1, 1, {1, 2}});
+  CHECK_EQ(data.get_degree_bucket(0), std::vector<size_t>{0});
+  CHECK_EQ(data.get_degree_bucket(1), std::vector<size_t>{1, 2});
+  CHECK_EQ(data.get_degree_bucket(2), std::vector<size_t>{});
+  CHECK_EQ(data.get_degree_bucket(3), std::vector<size_t>{3});
+
+  // Changing the netlist rebuilds them
+  data.add_block({13, 6, 0, 1, 1, {2}});
+  CHECK_EQ(data.get_degree_bucket(1), std::vector<size_t>{1});
+  CHECK_EQ(data.get_degree_bucket(2), std::vector<size_t>{2});
+}
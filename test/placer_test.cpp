@@ -6,9 +6,9 @@
 TEST_CASE("Simple placement") {
   Data data(500, 505);
 
-  data.add_net({0, {}});
-  data.add_net({2, {}});
-  data.add_net({3, {}});
+  data.add_net({0});
+  data.add_net({2});
+  data.add_net({3});
   REQUIRE_EQ(data.num_nets, 3);
 
   data.add_block({10, 0, 0, 200, 300, {0, 3}});
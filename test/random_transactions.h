@@ -0,0 +1,39 @@
+#pragma once
+
+#include "../include/data.h"
+#include <cstdint>
+
+// Runs steps transactions of five random shifts, swaps, rotations and flips on
+// a placed data. check(true) is called with the transaction still open, then
+// a coin flip rolls it back or commits it and check(false) is called
+template <class Rng, class Check>
+void random_transactions(Data &data, Rng &rng, int steps, Check check) {
+  for (int step = 0; step < steps; step++) {
+    data.begin_transaction();
+    for (int i = 0; i < 5; i++) {
+      block &b = data.get_block_by_index(rng() % data.num_blocks);
+      switch (rng() % 4) {
+      case 0:
+        data.try_shift(b, static_cast<int32_t>(rng() % 21) - 10,
+                       static_cast<int32_t>(rng() % 21) - 10);
+        break;
+      case 1:
+        data.try_swap(b, data.get_block_by_index(rng() % data.num_blocks));
+        break;
+      case 2:
+        data.try_rot_cw(b);
+        break;
+      default:
+        data.try_flip_h(b);
+        break;
+      }
+    }
+    check(true);
+    if (rng() % 2 == 0) {
+      data.rollback();
+    } else {
+      data.commit();
+    }
+    check(false);
+  }
+}
@@ -0,0 +1,78 @@
+#include "../include/xoshiro256pp.h"
+#include "doctest.h"
+#include <cstdint>
+#include <vector>
+
+// Xoshiro256pp Tests
+TEST_CASE("Xoshiro256pp") {
+  SUBCASE("Reference output") {
+    // First numbers of the reference implementation for this state
+    Xoshiro256pp rng(1, 2, 3, 4);
+    CHECK_EQ(rng.next(), 41943041);
+    CHECK_EQ(rng.next(), 58720359);
+    CHECK_EQ(rng.next(), 3588806011781223);
+    CHECK_EQ(rng.next(), 3591011842654386);
+    CHECK_EQ(rng.next(), 9228616714210784205u);
+  }
+
+  SUBCASE("Jumps") {
+    Xoshiro256pp rng(1, 2, 3, 4);
+    rng.jump();
+    CHECK_EQ(rng.next(), 17043750140134683703u);
+    Xoshiro256pp far(1, 2, 3, 4);
+    far.long_jump();
+    CHECK_EQ(far.next(), 13097851138432240629u);
+  }
+
+  SUBCASE("Copies continue the same stream") {
+    Xoshiro256pp rng(42);
+    rng.next();
+    Xoshiro256pp copy = rng;
+    for (int i = 0; i < 100; i++) {
+      CHECK_EQ(rng.next(), copy.next());
+    }
+  }
+
+  SUBCASE("Seeds") {
+    Xoshiro256pp a(7);
+    Xoshiro256pp b(7);
+    Xoshiro256pp c(8);
+    uint64_t from_a = a.next();
+    CHECK_EQ(from_a, b.next());
+    CHECK_NE(from_a, c.next());
+  }
+
+  SUBCASE("fill() matches next()") {
+    Xoshiro256pp rng(3);
+    Xoshiro256pp single = rng;
+    std::vector<uint64_t> values(1001);
+    rng.fill(values);
+    for (uint64_t value : values) {
+      CHECK_EQ(value, single.next());
+    }
+    // The state moved on as well
+    CHECK_EQ(rng.next(), single.next());
+  }
+
+  SUBCASE("bounded()") {
+    // 2^64 = 5 * 3689348814741910323 + 1
+    CHECK_EQ(bounded_range(5).threshold, 1);
+    CHECK_EQ(bounded_range(1).threshold, 0);
+    CHECK_EQ(bounded_range(uint64_t{1} << 40).threshold, 0);
+
+    Xoshiro256pp rng(5);
+    bounded_range one(1);
+    bounded_range five(5);
+    std::vector<uint64_t> counts(5, 0);
+    for (int i = 0; i < 50'000; i++) {
+      CHECK_EQ(rng.bounded(one), 0);
+      uint64_t value = rng.bounded(five);
+      REQUIRE_LT(value, 5);
+      counts[value]++;
+    }
+    for (uint64_t count : counts) {
+      CHECK_GT(count, 9'500);
+      CHECK_LT(count, 10'500);
+    }
+  }
+}